@@ -0,0 +1,3533 @@
+/**
+ * GreenPak(SLG46826V) 書き込み処理
+ *
+ * mbed(main.cpp)とPC上のsimulator(host/)の両方で使う
+ *
+ * @file
+ */
+
+#include "GreenPak.h"
+#include "GreenPakDevice.h"
+#include <string.h>
+
+//=====================================
+// HEX file
+//=====================================
+const char *localDir = "/local/"; //<! HEX fileの置き場所
+
+#define Z_bufferNumber                                                         \
+  (1024) // HEX fileは1行44byte x 17行なのでこれ以上のbyte数があればよい
+         // (file全体を1回のfread()で読み込む)
+
+char buffer[Z_bufferNumber] AHBSRAM0; // 読みだしたデータの保管先
+
+hexCache_t hexCache[2] = {}; //<! 解析済みHEX file(0:NVM.hex, 1:EEPROM.hex)
+
+uint8_t imageSlaveAddress = 0xff; //<! .gpbで指定されたslave address
+uint8_t imageDeviceId = 0;        //<! .gpbで指定された型番(0:指定なし)
+ramImage_t ramImage[2] AHBSRAM0; //<! PCから受け取った書き込みデータ
+
+//=====================================
+// GreenPak のI2C処理
+//=====================================
+uint8_t hexData[16][16] = {}; //<! hex fileから読みだしたデータの保管用
+uint8_t chipData[16][16] = {}; //<! GreenPakから読みだしたデータの保管用
+uint8_t hexPresent[32] = {};   //<! hexData[][]の読み込み済みbyte(1bit/byte)
+bool hexVerbose = false; //<! true:HEX file読み込み時にrecordの内容を表示
+
+char i2cBuffer
+    [17]; //<! I2C送受信用バッファ(GreenPakのaddress(1byte)+data(16byte)=17byte)
+
+uint32_t ackPollTimeoutUs = Z_ackPollTimeoutUs;   //<! ACK待ちの制限時間[us]
+uint32_t ackPollIntervalUs = Z_ackPollIntervalUs; //<! ACK確認間隔[us]
+
+ackPollResult_t ackPollLast = {}; //<! 直前のACK確認結果
+
+int pageRetries = Z_pageRetries;         //<! retry回数
+uint32_t pageBackoffUs = Z_pageBackoffUs; //<! 1回目のretry前の待ち時間[us]
+writeResume_t resume AHBSRAM0; //<! 直前の書き込みのretry回数と続きの情報
+
+settleProfile_t settle = {false,
+                          Z_settleMarginPct,
+                          {Z_settlePingUs, Z_settleGapUs, Z_settleReadyUs,
+                           Z_settleEraseUs}}; //<! 処理後の待ち時間
+
+bool autoVerify = false;         //<! true:書き込み後に内容を確認する
+verifyResult_t verifyLast = {}; //<! 直前の書き込み内容確認結果
+
+greenPakDevice_t session = {}; //<! 操作対象GreenPak
+uint8_t deviceType = GPB_DEVICE_SLG46826; //<! 操作対象GreenPakの型番
+
+/**
+ * 選択中の型番(deviceType)のtraits(GreenPakDevice.h)で処理を呼び出す
+ *
+ * 型番の分岐はここだけで、呼び出した先の処理は型番ごとにcompileされている
+ * @param function: 呼び出すtemplate関数
+ * @param args: 引数(括弧付き)
+ */
+#define DEVICE_DISPATCH(function, args)                                        \
+  switch (deviceType) {                                                        \
+  case GPB_DEVICE_SLG46824:                                                    \
+    return function<Slg46824> args;                                            \
+  case GPB_DEVICE_SLG46827:                                                    \
+    return function<Slg46827> args;                                            \
+  default:                                                                     \
+    return function<Slg46826> args;                                            \
+  }
+
+template <class Device> static void powercycle(greenPakDevice_t *dev);
+template <class Device> static void resister_unprotect(greenPakDevice_t *dev);
+template <class Device>
+static int erasePages(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                      uint16_t pageMask);
+template <class Device>
+static int eraseChip(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+template <class Device>
+static int writePages(int control_code, int addressForAckPolling,
+                      uint16_t pageMask);
+template <class Device>
+static int writeChip(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                     int nextSlaveAddress, bool diff);
+template <class Device>
+static int readBlock(int slaveAddress, greenPakMemory_t memoryType,
+                     uint8_t data[16][16]);
+static int verifyImage(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                       const uint8_t expect[16][16]);
+
+const int busSpeedList[Z_busSpeeds] = {400000, 100000,
+                                       10000}; //<! 試すI2C clock[Hz]
+int busHz = 0;              //<! 使用中のI2C clock[Hz] 0:未決定
+int busPinnedHz = 0;        //<! 固定したI2C clock[Hz] 0:自動選択
+uint32_t busBytesPerSec = 0; //<! 直前に測定した読み出し速度[byte/s]
+
+//=====================================
+// file
+//=====================================
+/**
+ * localDirにあるfileを開く
+ *
+ * @param[in] const char* name: file名("NVM.hex"など)
+ * @param[in] const char* mode: fopen()のmode
+ * @return fopen()の戻り値
+ */
+FILE *localOpen(const char *name, const char *mode) {
+  char path[64];
+  snprintf(path, sizeof(path), "%s%s", localDir, name);
+  return fopen(path, mode);
+}
+
+//=====================================
+// CRC
+//=====================================
+/**
+ * CRC32(IEEE 802.3, zlibと同じ)の計算
+ *
+ * 4bit単位のtableで計算する(table: 64byte)
+ * @param[in] const uint8_t* data: 計算対象
+ * @param[in] int length: byte数
+ * @param[in] uint32_t crc: 続きを計算する場合は前回の結果, 最初は0
+ * @return CRC32
+ */
+uint32_t crc32(const uint8_t *data, int length, uint32_t crc) {
+  static const uint32_t table[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+      0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+  crc = ~crc;
+  for (int i = 0; i < length; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0f];
+    crc = (crc >> 4) ^ table[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+//=====================================
+// HEX file 読み込み
+//=====================================
+/**
+ * asciiコード1文字をhexに変換
+ *
+ * @param[in] char* p : 文字の入った変数のポインタ
+ * @return 変換結果 0x00 ～ 0x0f, 0xff:変換不能
+ */
+uint8_t atoh1(char *p) {
+  char a = *p;
+  uint8_t ans = 0xff;
+
+  if (('0' <= a) && (a <= '9')) {
+    ans = a - '0';
+  } else if (('a' <= a) && (a <= 'f')) {
+    ans = a - 'a' + 0x0a;
+  } else if (('A' <= a) && (a <= 'F')) {
+    ans = a - 'A' + 0x0a;
+  } else {
+    ans = 0xff;
+  }
+  return (ans);
+}
+
+/**
+ *  asciiコード2文字をhexに変換
+ *
+ * @param[in] char* p: 文字の入った変数ポインタ
+ * @return 変換結果 0x00 ～ 0xff (変換不能の場合は0xffにしている)
+ */
+uint8_t atoh2(char *p) {
+  uint8_t ans;
+  uint8_t up = atoh1(p);
+  uint8_t dn = atoh1(p + 1);
+  if ((up != 0xff) && (dn != 0xff)) {
+    ans = (up << 4) | dn;
+  } else {
+    // 変換不能
+    ans = 0xff;
+  }
+  return (ans);
+}
+
+/**
+ * asciiコード1文字 -> hex の変換表 (-1:変換不能)
+ *
+ * atoh1()と同じ変換を1回の表引きで行う
+ */
+static const int8_t hexDigit[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x00
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x10
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x20
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  -1, -1, -1, -1, -1, -1, // 0x30
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x40
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x50
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x60
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x70
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x80
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0x90
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xa0
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xb0
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xc0
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xd0
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xe0
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 0xf0
+};
+
+//*************************************
+/**
+ * HEX fileのascii文字列をbyte列に変換
+ *
+ * 変換表(hexDigit[])で1byteずつ変換し、変換不能の確認は最後に1回だけ行う
+ * (1文字ごとの範囲判定による分岐をなくしている)
+ * @param[in] const char* p: 文字列(2 x length文字)
+ * @param[out] uint8_t* data: 変換結果
+ * @param[in] int length: 変換するbyte数
+ * @return 0x00～0xff:変換したbyteの合計(下位8bit, checksum確認用), -1:変換不能
+ */
+//*************************************
+int hexDecode(const char *p, uint8_t *data, int length) {
+  const uint8_t *q = (const uint8_t *)p;
+  int bad = 0;
+  uint8_t sum = 0;
+
+  for (int i = 0; i < length; i++, q += 2) {
+    int up = hexDigit[q[0]];
+    int dn = hexDigit[q[1]];
+    bad |= up | dn; // 変換不能(-1)があれば負になる
+    data[i] = (up << 4) | (dn & 0x0f);
+    sum += data[i];
+  }
+  return (bad < 0) ? -1 : sum;
+}
+
+/**
+ * HEX file解析の開始
+ *
+ * hexData[][]とhexPresent[]を0x00に初期化する
+ * 0x00はNVM,EEPROM共に初期値なので安全側になる
+ * @param[out] hexParser_t* hp: 解析状態
+ */
+void hexParseBegin(hexParser_t *hp) {
+  memset(hexData, 0x00, sizeof(hexData));
+  memset(hexPresent, 0x00, sizeof(hexPresent));
+  memset(hp, 0x00, sizeof(*hp));
+}
+
+/**
+ * HEX fileの1行(1 record)の解析
+ *
+ * checksum,byte数,address範囲(0x0000～0x00ff),重複を確認して
+ * hexData[][]とhexPresent[]に格納する
+ * record type 00:data 01:end of file 02,04:拡張address に対応
+ * (03,05 のstart addressは無視する)
+ * 行末の改行,空白と空行は無視する
+ * @param[in,out] hexParser_t* hp: 解析状態
+ * @param[in] const char* line: 1行分の文字列
+ * @param[in] bool verbose: true:recordの内容をPCに表示する
+ * @return 0:正常 負:エラー(hexError_t)
+ */
+int hexParseLine(hexParser_t *hp, const char *line, bool verbose) {
+  uint8_t record[4 + 255 + 1]; // byte count,address(2),type,data,checksum
+  const char *p = line;
+
+  hp->line++;
+
+  // 行末の改行,空白を除いた長さ
+  int chars = strlen(line);
+  while ((chars > 0) && ((unsigned char)line[chars - 1] <= ' ')) {
+    chars--;
+  }
+  if (chars == 0) {
+    return HEX_OK; // 空行
+  }
+  if (hp->eof) {
+    return HEX_ERR_AFTER_EOF;
+  }
+  if ((*p++ != ':') || ((chars & 1) == 0)) {
+    return HEX_ERR_FORMAT;
+  }
+
+  // 全byteを変換してchecksumを確認する
+  // (record[]に入りきらない行は、入る分に変換不能がなければbyte数の異常)
+  int length = chars >> 1;
+  int sum = hexDecode(p, record,
+                      (length < (int)sizeof(record)) ? length : sizeof(record));
+  if (sum < 0) {
+    return HEX_ERR_FORMAT;
+  }
+  if (length > (int)sizeof(record)) {
+    return HEX_ERR_LENGTH;
+  }
+  if ((length < 5) || (record[0] != length - 5)) {
+    return HEX_ERR_LENGTH;
+  }
+  if (sum != 0) {
+    return HEX_ERR_CHECKSUM;
+  }
+
+  uint8_t byteCount = record[0];
+  uint32_t address = (record[1] << 8) | record[2];
+  uint8_t recodeType = record[3];
+  uint8_t *data = &record[4];
+
+  if (verbose) {
+    pc.printf("address=%04lx type=%02x : ",
+              (unsigned long)(hp->base + address), recodeType);
+    for (int i = 0; i < byteCount; i++) {
+      pc.printf("%02x", data[i]);
+    }
+    pc.printf("\n");
+  }
+
+  switch (recodeType) {
+  case 0x00: // data
+    // GreenPakは256byteなので、baseは0のみ. 和は一巡するので比較しない
+    if ((hp->base != 0) || (address > 0x100u - byteCount)) {
+      return HEX_ERR_RANGE;
+    }
+    for (int i = 0; i < byteCount; i++, address++) {
+      uint8_t bit = 1 << (address & 0x07);
+      if (hexPresent[address >> 3] & bit) {
+        return HEX_ERR_OVERLAP;
+      }
+      hexPresent[address >> 3] |= bit;
+      hexData[address >> 4][address & 0x0f] = data[i];
+    }
+    hp->records++;
+    hp->bytes += byteCount;
+    break;
+  case 0x01: // end of file
+    if (byteCount != 0) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->eof = true;
+    break;
+  case 0x02: // extended segment address
+    if (byteCount != 2) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->base = (uint32_t)((data[0] << 8) | data[1]) << 4;
+    break;
+  case 0x04: // extended linear address
+    if (byteCount != 2) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->base = (uint32_t)((data[0] << 8) | data[1]) << 16;
+    break;
+  case 0x03: // start segment address
+  case 0x05: // start linear address
+    break;
+  default:
+    return HEX_ERR_TYPE;
+  }
+  return HEX_OK;
+}
+
+/**
+ * HEX file解析の終了
+ *
+ * @param[in] hexParser_t* hp: 解析状態
+ * @return 0:正常 負:エラー(hexError_t)
+ */
+int hexParseEnd(hexParser_t *hp) {
+  if (!hp->eof) {
+    return HEX_ERR_NO_EOF;
+  }
+  return HEX_OK;
+}
+
+/**
+ * 1byteをascii 2文字(大文字)にする
+ */
+static char *hexPut(char *p, uint8_t data) {
+  static const char digits[] = "0123456789ABCDEF";
+  *p++ = digits[data >> 4];
+  *p++ = digits[data & 0x0f];
+  return p;
+}
+
+//*************************************
+/**
+ * 256byteのデータをHEX fileの形式にする
+ *
+ * GreenPAK Designerが出力するHEX fileと同じ形式(16byteのdata record x16,
+ * end of file record, 改行はLF, 最後の行は改行なし)にする
+ * @param[in] uint8_t data[16][16]: データ
+ * @param[out] char* text: 格納先(Z_hexFileSize+1 byte以上, 最後に'\0'を付ける)
+ * @return 文字数(Z_hexFileSize)
+ */
+//*************************************
+int hexFormat(const uint8_t data[16][16], char *text) {
+  char *p = text;
+
+  for (int i = 0; i < 16; i++) {
+    uint8_t sum = 0x10 + (i << 4); // byte count + address(下位)
+    *p++ = ':';
+    p = hexPut(p, 0x10);   // byte count
+    p = hexPut(p, 0x00);   // address(上位)
+    p = hexPut(p, i << 4); // address(下位)
+    p = hexPut(p, 0x00);   // record type: data
+    for (int j = 0; j < 16; j++) {
+      p = hexPut(p, data[i][j]);
+      sum += data[i][j];
+    }
+    p = hexPut(p, -sum);
+    *p++ = '\n';
+  }
+  memcpy(p, ":00000001FF", 11); // end of file
+  p += 11;
+  *p = '\0';
+  return p - text;
+}
+
+/**
+ * HEX file解析エラーの内容
+ *
+ * @param[in] int error: hexError_t
+ * @return エラー内容の文字列
+ */
+const char *hexErrorText(int error) {
+  switch (error) {
+  case HEX_OK:
+    return "OK";
+  case HEX_ERR_FORMAT:
+    return "format error";
+  case HEX_ERR_LENGTH:
+    return "byte count error";
+  case HEX_ERR_CHECKSUM:
+    return "checksum error";
+  case HEX_ERR_TYPE:
+    return "unknown record type";
+  case HEX_ERR_RANGE:
+    return "address out of range";
+  case HEX_ERR_OVERLAP:
+    return "address overlap";
+  case HEX_ERR_AFTER_EOF:
+    return "data after end of file";
+  case HEX_ERR_NO_EOF:
+    return "no end of file record";
+  case HEX_ERR_FILE:
+    return "file not found";
+  case HEX_ERR_SIZE:
+    return "file too large";
+  default:
+    return "unknown error";
+  }
+}
+
+/**
+ * fileをbuffer[]に読み込む
+ *
+ * file全体を1回のfread()で読み込み、最後に'\0'を付ける
+ * @param[in] const char* name: file名(localDirからの相対)
+ * @param[out] uint32_t* crc: file内容のCRC32
+ * @return 0以上:file size, 負:エラー(HEX_ERR_FILE,HEX_ERR_SIZE)
+ */
+static int hexFileLoad(const char *name, uint32_t *crc) {
+  FILE *fp = localOpen(name, "r");
+  if (fp == NULL) {
+    return HEX_ERR_FILE;
+  }
+  int size = fread(buffer, 1, Z_bufferNumber, fp);
+  fclose(fp);
+  if (size >= Z_bufferNumber) {
+    return HEX_ERR_SIZE;
+  }
+  buffer[size] = 0x00;
+  *crc = crc32((const uint8_t *)buffer, size);
+  return size;
+}
+
+/**
+ * buffer[]に読み込んだHEX fileを1行ずつ解析してhexData[][]に格納する
+ *
+ * @param[out] hexParser_t* hp: 解析結果(異常時はhp->lineが異常な行)
+ * @return 0:正常 負:エラー(hexError_t)
+ */
+static int hexBufferParse(hexParser_t *hp) {
+  int ans = HEX_OK;
+
+  hexParseBegin(hp);
+  char *line = buffer;
+  while ((ans == HEX_OK) && (*line != 0x00)) {
+    char *next = strchr(line, '\n');
+    if (next != NULL) {
+      *next++ = 0x00;
+    } else {
+      next = line + strlen(line);
+    }
+    ans = hexParseLine(hp, line, hexVerbose);
+    line = next;
+  }
+  if (ans == HEX_OK) {
+    ans = hexParseEnd(hp);
+  }
+  return ans;
+}
+
+/**
+ * HEX fileを読み出す
+ *
+ * 対象ファイルは"NVM.hex"か"EEPROM.hex"の決め打ち
+ * file全体を1回で読み込み、前回解析した時とsize,CRCが同じであれば
+ * 解析済みの内容(hexCache)を使う。変わっていれば1行ずつ解析して
+ * hexData[][]に格納する。異常なrecordがあれば読み込みを中止する
+ * PCへの表示は1行の結果だけ(hexVerbose=trueの時はrecordの内容も表示する)
+ * @param[in] 格納対象データ greenPakMemory_t NVM,RESISTER: NVM.hex, EEPROM:
+ * EEPROM.hexを読み込む
+ * @return 0～256:読み込んだbyte数(正常なら256になる), 負:エラー(hexError_t)
+ */
+int hexFileRead(greenPakMemory_t memoryType) {
+  hexParser_t hp;
+  hexCache_t *cache;
+  uint32_t crc;
+
+  switch (memoryType) {
+  case NVM:
+  case RESISTER:
+    cache = &hexCache[0];
+    break;
+  case EEPROM:
+    cache = &hexCache[1];
+    break;
+  default:
+    return HEX_ERR_FILE;
+  }
+  const char *name = hexCacheName(cache);
+  uint32_t start = traceStart();
+
+  int size = hexFileLoad(name, &crc);
+  if (size < 0) {
+    pc.log(CONSOLE_QUIET, "HEX file read: %s %s\n", name, hexErrorText(size));
+    return size;
+  }
+
+  // 前回と同じ内容なら解析しない
+  if (cache->valid && (cache->size == (uint32_t)size) && (cache->crc == crc)) {
+    memcpy(hexData, cache->data, sizeof(hexData));
+    memcpy(hexPresent, cache->present, sizeof(hexPresent));
+    cache->hits++;
+    traceEnd(TRACE_HEX, start);
+    pc.printf("HEX file read: %s %d records %d bytes (cache)\n", name,
+              cache->records, cache->bytes);
+    return cache->bytes;
+  }
+  cache->valid = false;
+
+  // 1行ずつ解析する
+  int ans = hexBufferParse(&hp);
+  if (ans != HEX_OK) {
+    pc.log(CONSOLE_QUIET, "HEX file read: %s line %d %s\n", name, hp.line,
+              hexErrorText(ans));
+    return ans;
+  }
+
+  cache->valid = true;
+  cache->size = size;
+  cache->crc = crc;
+  cache->ageUs = 0;
+  cache->lastUs = Wire.read_us();
+  cache->records = hp.records;
+  cache->bytes = hp.bytes;
+  cache->hits = 0;
+  memcpy(cache->data, hexData, sizeof(hexData));
+  memcpy(cache->present, hexPresent, sizeof(hexPresent));
+  traceEnd(TRACE_HEX, start);
+
+  pc.printf("HEX file read: %s %d records %d bytes\n", name, hp.records,
+            hp.bytes);
+  return hp.bytes;
+}
+
+/**
+ * 解析済みHEX fileのfile名
+ *
+ * @param[in] const hexCache_t* cache: hexCache[]のどれか
+ * @return file名
+ */
+const char *hexCacheName(const hexCache_t *cache) {
+  return (cache == &hexCache[1]) ? "EEPROM.hex" : "NVM.hex";
+}
+
+/**
+ * 解析してからの経過時間の積算
+ *
+ * read_us()が一巡する(約71分)までに呼び出す. main()のloopの他、
+ * 量産モード,SCRIPT.txt,binary通信のように戻ってこないloopからも呼び出す
+ */
+void hexCacheTick(void) {
+  uint32_t now = Wire.read_us();
+  for (int i = 0; i < 2; i++) {
+    hexCache_t *cache = &hexCache[i];
+    cache->ageUs += (uint32_t)(now - cache->lastUs);
+    cache->lastUs = now;
+  }
+}
+
+/**
+ * 解析済みHEX fileの状態表示
+ */
+void hexCachePrint(void) {
+  hexCacheTick();
+  for (int i = 0; i < 2; i++) {
+    hexCache_t *cache = &hexCache[i];
+    if (!cache->valid) {
+      pc.printf("%-10s: empty\n", hexCacheName(cache));
+      continue;
+    }
+    pc.printf("%-10s: size=%lu crc=%08lx %d bytes, parsed %lus ago, hit=%lu\n",
+              hexCacheName(cache), (unsigned long)cache->size,
+              (unsigned long)cache->crc, cache->bytes,
+              (unsigned long)(cache->ageUs / 1000000),
+              (unsigned long)cache->hits);
+  }
+}
+
+/**
+ * 解析済みHEX fileの破棄
+ *
+ * 次の読み込みでは必ずHEX fileを解析する
+ */
+void hexCacheFlush(void) { memset(hexCache, 0x00, sizeof(hexCache)); }
+
+//=====================================
+// binary image file (.gpb)
+//=====================================
+/**
+ * hexData[][]から.gpbの作成
+ *
+ * @param[out] gpbImage_t* image: 作成先
+ * @param[in] greenPakMemory_t target: 書き込み対象領域
+ * @param[in] uint8_t slaveAddress: NVM書き込み時のslave address
+ * (0x00～0x0f, 0xff:書き込み時の指示,現状のaddressに従う)
+ */
+void gpbEncode(gpbImage_t *image, greenPakMemory_t target,
+               uint8_t slaveAddress) {
+  memset(image, 0x00, sizeof(*image));
+  memcpy(image->header.magic, GPB_MAGIC, 4);
+  image->header.version = GPB_VERSION;
+  image->header.target = target;
+  image->header.deviceId = deviceType;
+  image->header.slaveAddress = slaveAddress;
+  memcpy(image->data, hexData, sizeof(image->data));
+
+  uint32_t crc = crc32(&image->data[0][0], sizeof(image->data));
+  for (int i = 0; i < 4; i++) {
+    image->header.crc[i] = (uint8_t)(crc >> (i * 8));
+  }
+}
+
+/**
+ * .gpbの内容確認とhexData[][]への格納
+ *
+ * @param[in] const gpbImage_t* image: 読み込んだ.gpb
+ * @param[in] greenPakMemory_t target: 書き込み対象領域
+ * @return 0:正常 負:エラー(hexError_t)
+ */
+int gpbDecode(const gpbImage_t *image, greenPakMemory_t target) {
+  const gpbHeader_t *header = &image->header;
+  if ((memcmp(header->magic, GPB_MAGIC, 4) != 0) ||
+      (header->version != GPB_VERSION)) {
+    return HEX_ERR_FORMAT;
+  }
+  // NVM用のimageはRESISTERにも書き込める
+  greenPakMemory_t block = (target == RESISTER) ? NVM : target;
+  if (((header->target == RESISTER) ? NVM : header->target) != block) {
+    return HEX_ERR_TYPE;
+  }
+  if (deviceName(header->deviceId) == NULL) {
+    return HEX_ERR_TYPE;
+  }
+  uint32_t crc = 0;
+  for (int i = 0; i < 4; i++) {
+    crc |= (uint32_t)header->crc[i] << (i * 8);
+  }
+  if (crc32(&image->data[0][0], sizeof(image->data)) != crc) {
+    return HEX_ERR_CHECKSUM;
+  }
+
+  memcpy(hexData, image->data, sizeof(hexData));
+  memset(hexPresent, 0xff, sizeof(hexPresent));
+  imageSlaveAddress = header->slaveAddress;
+  imageDeviceId = header->deviceId;
+  return HEX_OK;
+}
+
+/**
+ * 書き込みデータで指定された型番への切り替え
+ *
+ * 型番の指定(.gpbのheader)がなければ選択中の型番のままにする
+ */
+static void imageDeviceApply(void) {
+  if ((imageDeviceId != 0) && (imageDeviceId != deviceType)) {
+    deviceSelect(imageDeviceId);
+    pc.printf("device = %s (image)\n", deviceName(deviceType));
+  }
+}
+
+/**
+ * 書き込みデータの読み出し
+ *
+ * PCから受け取ったRAM上のimage(ramImage[])があればそれを使う
+ * NVM.gpb/EEPROM.gpbがあれば1回のfread()で読み込み、
+ * なければNVM.hex/EEPROM.hexを読み込む(hexFileRead())
+ * imageに型番の指定があれば、操作対象の型番(deviceType)をそれに切り替える
+ * @param[in] greenPakMemory_t NVM,RESISTER: NVM.gpb(.hex), EEPROM:
+ * EEPROM.gpb(.hex)を読み込む
+ * @return 0～256:読み込んだbyte数(正常なら256になる), 負:エラー(hexError_t)
+ */
+int imageRead(greenPakMemory_t memoryType) {
+  const char *name = (memoryType == EEPROM) ? "EEPROM.gpb" : "NVM.gpb";
+
+  imageSlaveAddress = 0xff;
+  imageDeviceId = 0;
+
+  ramImage_t *ram = &ramImage[(memoryType == EEPROM) ? 1 : 0];
+  if (ram->valid) {
+    memcpy(hexData, ram->data, sizeof(hexData));
+    memset(hexPresent, 0xff, sizeof(hexPresent));
+    imageSlaveAddress = ram->slaveAddress;
+    imageDeviceId = ram->deviceId;
+    pc.printf("image read: RAM 256 bytes\n");
+    imageDeviceApply();
+    return 256;
+  }
+
+  FILE *fp = localOpen(name, "rb");
+  if (fp == NULL) {
+    return hexFileRead(memoryType);
+  }
+  int size = fread(buffer, 1, Z_bufferNumber, fp);
+  fclose(fp);
+
+  int ans = HEX_ERR_SIZE;
+  if (size == sizeof(gpbImage_t)) {
+    ans = gpbDecode((const gpbImage_t *)buffer, memoryType);
+  }
+  if (ans != HEX_OK) {
+    pc.log(CONSOLE_QUIET, "image read: %s %s\n", name, hexErrorText(ans));
+    return ans;
+  }
+  pc.printf("image read: %s 256 bytes\n", name);
+  imageDeviceApply();
+  return 256;
+}
+
+//*************************************
+/**
+ * RAM上の書き込みデータの破棄
+ *
+ * 次の書き込みからHEX file,.gpbを使う
+ */
+//*************************************
+void ramImageClear(void) { memset(ramImage, 0x00, sizeof(ramImage)); }
+
+//=====================================
+// 書き込みデータのlibrary
+//=====================================
+librarySlot_t library[Z_librarySlots] AHBSRAM1; //<! 書き込みデータのlibrary
+
+//*************************************
+/**
+ * fileをlibraryのslotに読み込む
+ *
+ * HEX fileは解析して、.gpb(host/hex2gpbで変換したfile)はそのまま読み込む
+ * 読み込みに失敗した場合はslotを空にする
+ * @param[in] int slot: slot番号(0～Z_librarySlots-1)
+ * @param[in] greenPakMemory_t NVM,EEPROM 書き込み先
+ * @param[in] const char* name: file名(localDirからの相対, 8.3形式)
+ * @return 0:正常終了 負:エラー(hexError_t)
+ */
+//*************************************
+int libraryLoad(int slot, greenPakMemory_t memoryType, const char *name) {
+  if ((slot < 0) || (Z_librarySlots <= slot) || (memoryType == RESISTER) ||
+      (strlen(name) >= sizeof(library[0].name))) {
+    return HEX_ERR_FILE;
+  }
+  librarySlot_t *lib = &library[slot];
+  uint32_t crc;
+  int ans;
+
+  lib->valid = false;
+  imageSlaveAddress = 0xff;
+  imageDeviceId = 0;
+  int size = hexFileLoad(name, &crc);
+  if (size < 0) {
+    ans = size;
+  } else if ((size == sizeof(gpbImage_t)) &&
+             (memcmp(buffer, GPB_MAGIC, 4) == 0)) {
+    ans = gpbDecode((const gpbImage_t *)buffer, memoryType);
+  } else {
+    hexParser_t hp;
+    ans = hexBufferParse(&hp);
+    if ((ans == HEX_OK) && (hp.bytes != 256)) {
+      ans = HEX_ERR_LENGTH;
+    }
+  }
+  if (ans != HEX_OK) {
+    pc.log(CONSOLE_QUIET, "library: %s %s\n", name, hexErrorText(ans));
+    return ans;
+  }
+
+  memcpy(lib->data, hexData, sizeof(lib->data));
+  strcpy(lib->name, name);
+  lib->memoryType = memoryType;
+  lib->crc = crc;
+  lib->slaveAddress = imageSlaveAddress;
+  lib->deviceId = imageDeviceId;
+  lib->valid = true;
+  return HEX_OK;
+}
+
+//*************************************
+/**
+ * libraryのslotを書き込みデータにする
+ *
+ * slotの内容を書き込み先に合わせてramImage[]にcopyする
+ * 以後の書き込み(wn,we,m,gnなど)はこのimageを使う(hfで破棄する)
+ * @param[in] int slot: slot番号
+ * @return 0:正常終了 -1:空のslot
+ */
+//*************************************
+int librarySelect(int slot) {
+  if ((slot < 0) || (Z_librarySlots <= slot) || !library[slot].valid) {
+    pc.log(CONSOLE_QUIET, "library: slot %x empty\n", slot & 0x0f);
+    return -1;
+  }
+  const librarySlot_t *lib = &library[slot];
+  ramImage_t *ram = &ramImage[(lib->memoryType == EEPROM) ? 1 : 0];
+
+  memcpy(ram->data, lib->data, sizeof(ram->data));
+  ram->slaveAddress = lib->slaveAddress;
+  ram->deviceId = lib->deviceId;
+  ram->pages = 0xffff;
+  ram->valid = true;
+  pc.printf("library: slot %x %s selected\n", slot, lib->name);
+  return 0;
+}
+
+/**
+ * libraryのslotの内容の書き込み
+ *
+ * @return 0:正常終了 -1:異常終了
+ */
+int libraryProgram(greenPakDevice_t *dev, int slot) {
+  if (librarySelect(slot) != 0) {
+    return -1;
+  }
+  return writeChip(dev, library[slot].memoryType);
+}
+
+//*************************************
+/**
+ * libraryの一覧表示
+ *
+ * 選択中(ramImage[]と同じ内容)のslotには*を付ける
+ */
+//*************************************
+void libraryPrint(void) {
+  pc.log(CONSOLE_QUIET, "slot   memory name          file crc\n");
+  for (int i = 0; i < Z_librarySlots; i++) {
+    const librarySlot_t *lib = &library[i];
+    if (!lib->valid) {
+      continue;
+    }
+    const ramImage_t *ram = &ramImage[(lib->memoryType == EEPROM) ? 1 : 0];
+    bool selected =
+        ram->valid && (memcmp(ram->data, lib->data, sizeof(ram->data)) == 0);
+    pc.log(CONSOLE_QUIET, "%c %x    %-6s %-12s  %08lx\n", selected ? '*' : ' ',
+           i, (lib->memoryType == EEPROM) ? "EEPROM" : "NVM", lib->name,
+           (unsigned long)lib->crc);
+  }
+}
+
+//=====================================
+// GreenPak 操作
+//=====================================
+/**
+ * 全Control Codeの応答確認
+ *
+ * addressごとにsettleUs(SETTLE_PING)の間隔をあける
+ * @return 応答したControl Code(bit0=0x0 ～ bit15=0xf)
+ */
+static uint16_t pingScan(void) {
+  uint16_t present = 0;
+
+  for (int i = 0; i < 16; i++) {
+    int control_code = (i << 4) | RESISTER_CONFIG;
+    // ICに影響を与えないようにreadコマンドで確認する
+    if (Wire.read(control_code, i2cBuffer, 0) == 0) {
+      present |= 1 << i;
+    }
+    Wire.wait_us(settleUs(SETTLE_PING));
+  }
+  return present;
+}
+
+//*************************************
+/**
+ * GreenPakのslave address(Control Code)を確認
+ *
+ * PCへのモニタ表示用
+ */
+//*************************************
+void ping(void) {
+  uint16_t present = pingScan();
+
+  for (int i = 0; i < 16; i++) {
+    pc.log(CONSOLE_QUIET, "slave address =  0x%02x ", i);
+    if (present & (1 << i)) {
+      pc.log(CONSOLE_QUIET, " is present\n");
+    } else {
+      pc.log(CONSOLE_QUIET, " is not present\n");
+    }
+  }
+  pc.log(CONSOLE_QUIET, "\n");
+  Wire.wait(0.1);
+}
+
+//*************************************
+/**
+ * 接続されているGreenPakのslave addressを取得
+ *
+ * GreenPakの操作用
+ * @return 取得したslave address: 0x00～0x0f, 見つからなければ0xffを返す
+ */
+//*************************************
+int checkSlaveAddres(void) {
+  int control_code;
+  int address = 0xff;
+  int ans;
+
+  for (int i = 0; i < 16; i++) {
+    control_code = (i << 4) | RESISTER_CONFIG;
+
+    ans = Wire.read(control_code, i2cBuffer,
+                    0); // ICに影響を与えないようにreadコマンドで確認する
+    if (ans == 0) {
+      address = i;
+      //      pc.printf("slave address =  0x%02x\n", i);
+      break;
+    }
+  }
+  return (address);
+}
+
+//*************************************
+/**
+ * 操作対象GreenPakの確定
+ *
+ * 前回確認したslave addressが有効であれば、そのaddressへの1回の確認だけで済ませる
+ * 応答がなければ(GreenPakが交換された,addressが変わった)全addressを確認し直す
+ * 同じaddressの別のGreenPakに交換されても応答するので、残すのはslave addressだけにし、
+ * protect解除済みの記録は毎回消す
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @return 0:正常終了 -1:GreenPakが見つからない
+ */
+//*************************************
+int deviceOpen(greenPakDevice_t *dev) {
+  if (dev->valid) {
+    int control_code = (dev->slaveAddress << 4) | RESISTER_CONFIG;
+    if (Wire.read(control_code, i2cBuffer, 0) == 0) {
+      dev->unprotected = false;
+      return 0;
+    }
+  }
+
+  deviceInvalidate(dev);
+  int slaveAddress = checkSlaveAddres();
+  if ((slaveAddress == 0xff) && (busPinnedHz == 0) && (busHz > Z_busHzSafe)) {
+    // 速いclockで応答しないGreenPakに交換された場合は選び直す
+    busHz = 0;
+    Wire.frequency(Z_busHzSafe);
+    slaveAddress = checkSlaveAddres();
+  }
+  if (slaveAddress == 0xff) {
+    pc.log(CONSOLE_QUIET, "not found IC\n");
+    return -1;
+  }
+  dev->slaveAddress = slaveAddress;
+  dev->valid = true;
+  if (busHz == 0) {
+    busNegotiate(slaveAddress);
+  }
+  return 0;
+}
+
+//*************************************
+/**
+ * 操作対象GreenPakの確認結果の破棄
+ *
+ * slave address(0xCA)を書き換えた場合に呼び出す
+ * 次のdeviceOpen()で全addressを確認し直す
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ */
+//*************************************
+void deviceInvalidate(greenPakDevice_t *dev) {
+  dev->valid = false;
+  dev->unprotected = false;
+}
+
+//*************************************
+/**
+ * 操作対象GreenPakの型番の選択
+ *
+ * 以後のクリア,書き込み,読み出しはこの型番の定義(GreenPakDevice.h)で行う
+ * @param[in] uint8_t deviceId: 型番(GPB_DEVICE_xxx)
+ * @return 0:正常終了 -1:未対応の型番
+ */
+//*************************************
+int deviceSelect(uint8_t deviceId) {
+  if (deviceName(deviceId) == NULL) {
+    return -1;
+  }
+  deviceType = deviceId;
+  return 0;
+}
+
+/**
+ * 型番の名称
+ *
+ * @return 名称 NULL:未対応の型番
+ */
+const char *deviceName(uint8_t deviceId) {
+  switch (deviceId) {
+  case GPB_DEVICE_SLG46824:
+    return Slg46824::name();
+  case GPB_DEVICE_SLG46826:
+    return Slg46826::name();
+  case GPB_DEVICE_SLG46827:
+    return Slg46827::name();
+  default:
+    return NULL;
+  }
+}
+
+template <class Device> static bool deviceSupports(greenPakMemory_t memoryType) {
+  return Device::hasEeprom || (memoryType != EEPROM);
+}
+
+/**
+ * 選択中の型番が対象memoryを持っているか
+ *
+ * @return true:操作できる false:持っていない(SLG46824のEEPROMなど)
+ */
+bool deviceSupports(greenPakMemory_t memoryType) {
+  DEVICE_DISPATCH(deviceSupports, (memoryType));
+}
+
+/**
+ * 選択中の型番と対応している型番の表示
+ */
+void devicePrint(void) {
+  pc.log(CONSOLE_QUIET, "device = %s%s (", deviceName(deviceType),
+         deviceSupports(EEPROM) ? "" : " no EEPROM");
+  static const uint8_t list[] = {GPB_DEVICE_SLG46824, GPB_DEVICE_SLG46826,
+                                 GPB_DEVICE_SLG46827};
+  for (unsigned i = 0; i < sizeof(list); i++) {
+    pc.log(CONSOLE_QUIET, "%sn%02x", (i == 0) ? "" : ",", list[i]);
+  }
+  pc.log(CONSOLE_QUIET, ")\n");
+}
+
+//=====================================
+// I2C clock
+//=====================================
+/**
+ * 読み出し速度の測定用読み出し
+ *
+ * NVM全体をreadBlock()で読み出す
+ * @param[in] int slaveAddress: 読み出すGreenPakのslave address
+ * @param[out] uint8_t data[16][16]: 読み出し内容
+ * @param[out] uint32_t* us: 読み出しにかかった時間[us]
+ * @return 0:正常終了 -1:NACK
+ */
+static int busReadTest(int slaveAddress, uint8_t data[16][16], uint32_t *us) {
+  uint32_t start = Wire.read_us();
+  int ans = readBlock(slaveAddress, NVM, data);
+  *us = Wire.read_us() - start;
+  return ans;
+}
+
+/**
+ * 読み出し速度[byte/s]
+ */
+static uint32_t busRate(uint32_t us) {
+  return (us == 0) ? 0 : (uint32_t)(256ULL * 1000000 / us);
+}
+
+//*************************************
+/**
+ * I2C clockの選択
+ *
+ * Z_busHzSafeでNVMを読み出しておき、busSpeedList[]の速い順に同じ内容が
+ * 読み出せるかを確認する。NACK,内容の不一致があれば次のclockを試す
+ * clockを固定している場合(busPin())は確認せずに固定したclockを使う
+ * @param[in] int slaveAddress: 確認に使うGreenPakのslave address
+ * @return 0:正常終了 -1:どのclockでも読み出せない(Z_busHzSafeにする)
+ */
+//*************************************
+int busNegotiate(int slaveAddress) {
+  uint32_t us;
+
+  if (busPinnedHz != 0) {
+    busHz = busPinnedHz;
+    Wire.frequency(busHz);
+    return 0;
+  }
+
+  busHz = Z_busHzSafe;
+  Wire.frequency(busHz);
+  if (busReadTest(slaveAddress, chipData, &us) != 0) {
+    pc.printf("I2C %dkHz NG(nack)\n", busHz / 1000);
+    return -1;
+  }
+  uint32_t crc = crc32(chipData[0], 256);
+
+  for (int i = 0; i < Z_busSpeeds; i++) {
+    Wire.frequency(busSpeedList[i]);
+    if (busReadTest(slaveAddress, chipData, &us) != 0) {
+      pc.printf("I2C %dkHz NG(nack)\n", busSpeedList[i] / 1000);
+      Wire.wait_us(ackPollIntervalUs);
+      continue;
+    }
+    if (crc32(chipData[0], 256) != crc) {
+      pc.printf("I2C %dkHz NG(mismatch)\n", busSpeedList[i] / 1000);
+      continue;
+    }
+    busHz = busSpeedList[i];
+    busBytesPerSec = busRate(us);
+    pc.printf("I2C %dkHz %lu byte/s\n", busHz / 1000,
+              (unsigned long)busBytesPerSec);
+    return 0;
+  }
+
+  busHz = Z_busHzSafe;
+  Wire.frequency(busHz);
+  return -1;
+}
+
+//*************************************
+/**
+ * I2C clockを1段階遅くする
+ *
+ * 通信異常の証拠(データ転送のNACK,読み直しで内容が変わった)があった場合に呼び出し、
+ * 失敗した処理を遅くしたclockで1回だけやり直す
+ * (ACK待ちの時間切れ,GreenPakの内容の違いでは遅くしない)
+ * clockを固定している場合は変更しない
+ * @return 0:遅くした -1:変更できない(固定している,既に最も遅い)
+ */
+//*************************************
+int busFallback(void) {
+  if ((busPinnedHz != 0) || (busHz == 0)) {
+    return -1;
+  }
+  for (int i = 0; i < Z_busSpeeds; i++) {
+    if (busSpeedList[i] < busHz) {
+      busHz = busSpeedList[i];
+      Wire.frequency(busHz);
+      pc.log(CONSOLE_QUIET, "I2C -> %dkHz\n", busHz / 1000);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * busFallback()で遅くしたclockを戻す(通信異常ではなかった場合)
+ *
+ * @param[in] int hz: busFallback()前のclock[Hz]
+ */
+static void busRestore(int hz) {
+  busHz = hz;
+  Wire.frequency(busHz);
+  pc.log(CONSOLE_QUIET, "I2C -> %dkHz\n", busHz / 1000);
+}
+
+//*************************************
+/**
+ * I2C clockの固定
+ *
+ * busNegotiate()が選ぶ範囲(busSpeedList[]の最も遅い～最も速いclock)だけ受け付ける
+ * @param[in] int hz: 固定するI2C clock[Hz] 0:固定を解除(次のdeviceOpen()で選び直す)
+ * @return 0:正常終了 -1:範囲外(変更しない)
+ */
+//*************************************
+int busPin(int hz) {
+  if ((hz != 0) &&
+      ((hz < busSpeedList[Z_busSpeeds - 1]) || (hz > busSpeedList[0]))) {
+    pc.log(CONSOLE_QUIET, "I2C clock %d-%dkHz only\n",
+           busSpeedList[Z_busSpeeds - 1] / 1000, busSpeedList[0] / 1000);
+    return -1;
+  }
+  busPinnedHz = hz;
+  busHz = hz;
+  Wire.frequency((hz != 0) ? hz : Z_busHzSafe);
+  return 0;
+}
+
+//*************************************
+/**
+ * 使用中のI2C clockと読み出し速度の表示
+ *
+ * 使用中のclockでNVMを読み出して速度を測定する
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int busSpeedReport(greenPakDevice_t *dev) {
+  uint32_t us;
+
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  if (busReadTest(dev->slaveAddress, chipData, &us) != 0) {
+    pc.printf("I2C %dkHz NG(nack)\n", busHz / 1000);
+    return -1;
+  }
+  busBytesPerSec = busRate(us);
+  pc.printf("I2C %dkHz(%s) %lu byte/s\n", busHz / 1000,
+            (busPinnedHz != 0) ? "pinned" : "auto",
+            (unsigned long)busBytesPerSec);
+  return 0;
+}
+
+//*************************************
+/**
+ * greenPak 再起動指示
+ *
+ * NVMの書き換えをしたときにNVMの内容をRESISTERに反映させるために再起動させる
+ * 再起動でprotect設定(0xE1)もNVMから読み込まれるので、protect解除済みを取り消す
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ */
+//*************************************
+template <class Device> static void powercycle(greenPakDevice_t *dev) {
+  int control_code =
+      (dev->slaveAddress << 4) |
+      Device::resisterConfig; // ControlCode(A14-11)=slaveAddress(4bit) +
+                              // BlockAddress(A10-8)=000b
+  uint32_t start = traceStart();
+
+  pc.printf("Power Cycling!\n\n");
+  // Software reset
+  // レジスタアドレス=0xc8 bit1を1にすると I2C
+  // resetをしてNVMのデータをレジスタに転送することができる
+  i2cBuffer[0] = Device::regReset;
+  i2cBuffer[1] = Device::resetBit;
+  Wire.write(control_code, i2cBuffer,
+             2); // MASK_CONTROLCODEは Control Code:slave
+                 // addressを残しresisterアクセスにするためのマスク
+  // pc.printf("Done Power Cycling!\n");
+  dev->unprotected = false;
+  traceEnd(TRACE_POWERCYCLE, start);
+}
+
+void powercycle(greenPakDevice_t *dev) { DEVICE_DISPATCH(powercycle, (dev)); }
+
+//*************************************
+/**
+ * GreenPakのAck確認
+ *
+ * GreenPakへの操作指示後の動作完了をI2CのACKの受信で確認する
+ * ACKを受信した時点ですぐに戻る。ackPollTimeoutUsを超えても
+ * ACKが返らない場合は確認失敗とする
+ * 結果(poll回数,所要時間)はackPollLastに保存する
+ * @param[in] 確認対象のGreenPakのControl Byte
+ * @return 0:ACK, -1:確認失敗
+ */
+//*************************************
+int ackPolling(int addressForAckPolling) {
+  int ans;
+  uint32_t start = Wire.read_us();
+
+  ackPollLast.polls = 0;
+  ackPollLast.elapsedUs = 0;
+
+  while (1) {
+    ans = Wire.read(addressForAckPolling, i2cBuffer, 0);
+    ackPollLast.polls++;
+    ackPollLast.elapsedUs = Wire.read_us() - start;
+    if (ans == 0) {
+      traceEnd(TRACE_ACK, start, -1, ackPollLast.polls);
+      return 0;
+    }
+    if (ackPollLast.elapsedUs >= ackPollTimeoutUs) {
+      traceEnd(TRACE_ACK, start, -1, ackPollLast.polls);
+      pc.log(CONSOLE_QUIET, "Geez! Something went wrong while programming!\n");
+      return -1;
+    }
+    Wire.wait_us(ackPollIntervalUs);
+  }
+}
+
+//*************************************
+/**
+ * 直前のAck確認結果の表示
+ *
+ * poll回数とACKまでの時間(GreenPakのbusy時間)をPCに表示する
+ */
+//*************************************
+void printAckPolling(void) {
+  pc.log(CONSOLE_VERBOSE, "(poll=%lu, %luus) ", (unsigned long)ackPollLast.polls,
+         (unsigned long)ackPollLast.elapsedUs);
+}
+
+//*************************************
+/**
+ * 操作対象のmemoryの表示
+ *
+ * PCに操作対象になっているmemoryの種別を表示する
+ * @param[in] greenPakMemory_t 操作対象memory
+ */
+//*************************************
+void printMemoryType(greenPakMemory_t memoryType) {
+  switch (memoryType) {
+  case NVM:
+    pc.printf("memory = NVM\n");
+    break;
+  case EEPROM:
+    pc.printf("memory = EEPROM\n");
+    break;
+  case RESISTER:
+    pc.printf("memory = RESISTER\n");
+    break;
+  default:
+    pc.printf("memory = unknown\n");
+    break;
+  }
+}
+
+//*************************************
+/**
+ * 操作対象memoryのBlock Address
+ *
+ * Block AddressはSLG4682x共通(GreenPakDevice.h)
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @return Control ByteのBlock Address部
+ */
+//*************************************
+int blockConfig(greenPakMemory_t memoryType) {
+  // I2C Block Addressの設定
+  // A9=1, A8=0: NVM (0x02)
+  // A9=1, A8=1: EEPROM (0x03)
+  return Slg4682x::blockConfig(memoryType);
+}
+
+//*************************************
+/**
+ * GreenPak NVMプロテクト解除
+ *
+ * NVM書き込み時に誤ってNVMプロテクトをかけてしまった場合に、それを解除する
+ * 直前のdeviceOpen()の後で解除済みであれば何もしない
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ */
+//*************************************
+template <class Device> static void resister_unprotect(greenPakDevice_t *dev) {
+  if (dev->unprotected) {
+    return;
+  }
+  uint32_t start = traceStart();
+
+  int control_code =
+      (dev->slaveAddress << 4) |
+      Device::resisterConfig; // ControlCode(A14-11)=slaveAddress(4bit) +
+                              // BlockAddress(A10-8)=000b
+
+  // resisiterのプロテクトをクリアする
+  // レジスタアドレス: 0xE1 にNVMのプロテクト領域がある (HM p.171)
+  // 下位2bit 00: read/write/erase 可能
+  //          01: read禁止
+  //          10: write/erase 禁止
+  //          11: read/write/erase 禁止
+  i2cBuffer[0] = Device::regProtect;
+  i2cBuffer[1] = 0x00;
+  Wire.write(control_code, i2cBuffer,
+             2); // MASK_CONTROLCODEは Control Code:slave
+                 // addressを残しresisterアクセスにするためのマスク
+
+  i2cBuffer[0] = Device::regProtect;
+  Wire.write(control_code, i2cBuffer, 1);
+
+  // 0x00ならプロテクト解除されている
+  if (Wire.read(control_code, i2cBuffer, 1) == 0) {
+    dev->unprotected = ((i2cBuffer[0] & Device::protectMask) == 0x00);
+  }
+  traceEnd(TRACE_UNPROTECT, start);
+}
+
+void resister_unprotect(greenPakDevice_t *dev) {
+  DEVICE_DISPATCH(resister_unprotect, (dev));
+}
+
+/**
+ * pageMaskのpage数(進捗表示用)
+ */
+static int pageCount(uint16_t pageMask) {
+  int count = 0;
+  for (; pageMask != 0; pageMask &= pageMask - 1) {
+    count++;
+  }
+  return count;
+}
+
+/**
+ * pageのやり直し前の待ち
+ *
+ * 待ち時間はpageBackoffUsから始めてretryごとに倍にする
+ * やり直した回数はresume.retries[]に記録する
+ * @param[in] int page: やり直すpage
+ * @param[in] int retry: このpageでやり直した回数
+ * @param[in] const char* phase: 処理名(表示用)
+ * @return true:やり直す false:retry回数を使い切った
+ */
+static bool pageRetry(int page, int retry, const char *phase) {
+  if (retry >= pageRetries) {
+    resume.failedPage = page;
+    return false;
+  }
+  resume.retries[page]++;
+  uint32_t us = pageBackoffUs << retry;
+  pc.log(CONSOLE_QUIET, "page 0x%02x %s retry %d (%luus)\n", page, phase,
+         retry + 1, (unsigned long)us);
+  Wire.stop();
+  Wire.wait_us(us);
+  return true;
+}
+
+/**
+ * retryを使い切ったpageを、1段階遅いclockで1回だけやり直すか
+ *
+ * @param[in] bool nack: 最後の失敗がデータ転送のNACK(通信異常の証拠)
+ * @param[in,out] bool* done: true:このpageでは既にclockを遅くした
+ * @return true:やり直す false:やり直さない
+ */
+static bool busRetry(bool nack, bool *done) {
+  if (!nack || *done || (busFallback() != 0)) {
+    return false;
+  }
+  *done = true;
+  resume.failedPage = -1;
+  Wire.stop();
+  return true;
+}
+
+//*************************************
+/**
+ * 指示pageのクリア
+ *
+ * protect解除とpowercycleは呼び出し側で行う
+ * @param[in] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM クリア対象領域の指示
+ * @param[in] uint16_t pageMask: クリアするpage(bit0=page0 ～ bit15=page15)
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+template <class Device>
+static int erasePages(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                      uint16_t pageMask) {
+  int control_code =
+      (dev->slaveAddress << 4) |
+      Device::resisterConfig; // ControlCode(A14-11)=slaveAddress(4bit) +
+                              // BlockAddress(A10-8)=000b
+  int addressForAckPolling = control_code;
+  int total = pageCount(pageMask);
+  int done = 0;
+
+  // 失敗した場合は、このpageから続ける
+  resume.eraseMask = pageMask;
+
+  for (uint8_t i = 0; i < Device::pages; i++) {
+    if ((pageMask & (1 << i)) == 0) {
+      continue;
+    }
+    pc.progress("erase", done++, total);
+    pc.printf("Erasing page: 0x%02x ", i);
+    uint32_t start = traceStart();
+    int retry = 0;
+    int ans;
+
+    do {
+      i2cBuffer[0] = Device::regPageErase; // I2C Word Address
+      // Page Erase Register (Device::pageErase())
+      pc.printf((memoryType == EEPROM) ? "EEPROM " : "NVM ");
+      i2cBuffer[1] = Device::pageErase(memoryType, i);
+      Wire.write(control_code, i2cBuffer,
+                 2); // Control BYte = ControlCode + Block Address
+
+      /* To accommodate for the non-I2C compliant ACK behavior of the Page
+       * Erase Byte, we've removed the software check for an I2C ACK and added
+       * the "Wire.endTransmission();" line to generate a stop condition.
+       *  - Please reference "Issue 2: Non-I2C Compliant ACK Behavior for the
+       * NVM and EEPROM Page Erase Byte" in the SLG46824/6 (XC revision) errata
+       * document for more information.
+       *
+       * 要約: たまにNACKを返すことがあるので、無条件に終了させればよい。
+       * https://medium.com/dialog-semiconductor/slg46824-6-arduino-programming-example-1459917da8b
+       */
+
+      // tER(20ms)の処理終了待ち. 終わらなければ待ち時間を延ばしてやり直す
+      ans = ackPolling(addressForAckPolling);
+    } while ((ans == -1) && pageRetry(i, retry++, "erase"));
+
+    if (ans == -1) {
+      pc.log(CONSOLE_QUIET, "page 0x%02x erase NG\n", i);
+      return -1;
+    } else {
+      printAckPolling();
+      pc.printf("ready \n");
+      Wire.wait_us(settleUs(SETTLE_READY));
+      traceEnd(TRACE_ERASE, start, i);
+      resume.eraseMask &= ~(1 << i);
+    }
+  }
+  pc.progress("erase", done, total);
+  return 0;
+}
+
+int erasePages(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+               uint16_t pageMask) {
+  DEVICE_DISPATCH(erasePages, (dev, memoryType, pageMask));
+}
+
+//*************************************
+/**
+ * 指示memory領域のクリア指示
+ *
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER クリア対象領域の指示 　
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+template <class Device>
+static int eraseChip(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  if (!Device::hasEeprom && (memoryType == EEPROM)) {
+    pc.log(CONSOLE_QUIET, "%s has no EEPROM\n", Device::name());
+    return -1;
+  }
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  int slaveAddress = dev->slaveAddress;
+
+  pc.printf("slave address =  0x%02x\n", slaveAddress);
+
+  printMemoryType(memoryType);
+
+  if (memoryType == RESISTER) {
+    pc.printf("RESISTER don't erase area\n");
+    return (0);
+  }
+
+  resister_unprotect<Device>(dev);
+
+  // 既にクリアされているpageはクリアしない
+  if (readBlock<Device>(slaveAddress, memoryType, chipData) != 0) {
+    pc.log(CONSOLE_QUIET, "read NG\n");
+    return -1;
+  }
+  uint16_t pageMask = ~blankPages(chipData);
+  if (pageMask == 0) {
+    pc.printf("already blank\n");
+    return 0;
+  }
+
+  if (erasePages<Device>(dev, memoryType, pageMask) != 0) {
+    return -1;
+  }
+  pc.printf("\n");
+
+  powercycle<Device>(dev);
+  if ((memoryType == NVM) && (pageMask & (1 << 0xC))) {
+    // NVMの0xCA(slave address)もクリアしたので、再起動でaddressが変わる
+    deviceInvalidate(dev);
+  }
+  return 0;
+}
+
+int eraseChip(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  resume.pending = false; // クリアした後は書き込みの続きはできない
+  DEVICE_DISPATCH(eraseChip, (dev, memoryType));
+}
+
+//*************************************
+/**
+ * クリアされているpageの検索
+ *
+ * @param[in] uint8_t data[16][16]: GreenPakから読み出した内容
+ * @return クリアされている(全て0x00の)page(bit0=page0 ～ bit15=page15)
+ */
+//*************************************
+uint16_t blankPages(uint8_t data[16][16]) {
+  uint16_t pageMask = 0;
+  for (int i = 0; i < 16; i++) {
+    uint8_t bits = 0x00;
+    for (int j = 0; j < 16; j++) {
+      bits |= data[i][j];
+    }
+    if (bits == 0x00) {
+      pageMask |= (1 << i);
+    }
+  }
+  return pageMask;
+}
+
+//*************************************
+/**
+ * 指示memory領域のブランクチェック
+ *
+ * pageごとにクリアされているか(全て0x00か)をPCに表示する
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM 対象領域の指示
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int blankCheck(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  int slaveAddress = dev->slaveAddress;
+
+  pc.printf("slave address =  0x%02x\n", slaveAddress);
+
+  printMemoryType(memoryType);
+
+  if (memoryType == EEPROM) {
+    resister_unprotect(dev);
+  }
+  if (readBlock(slaveAddress, memoryType, chipData) != 0) {
+    pc.log(CONSOLE_QUIET, "read NG\n");
+    return -1;
+  }
+
+  uint16_t pageMask = blankPages(chipData);
+  int blank = 0;
+  for (int i = 0; i < 16; i++) {
+    if (pageMask & (1 << i)) {
+      pc.printf("page 0x%02x: blank\n", i);
+      blank++;
+    } else {
+      pc.printf("page 0x%02x: not blank\n", i);
+    }
+  }
+  pc.printf("blank %d / 16 pages\n", blank);
+  return 0;
+}
+
+//*************************************
+/**
+ * hexData[][]の指示pageの書き込み
+ *
+ * @param[in] int control_code: 書き込み先のControl Byte
+ * @param[in] int addressForAckPolling: ACK確認用のControl Byte
+ * @param[in] uint16_t pageMask: 書き込むpage(bit0=page0 ～ bit15=page15)
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+template <class Device>
+static int writePages(int control_code, int addressForAckPolling,
+                      uint16_t pageMask) {
+  static_assert(Device::pages * Device::pageSize == sizeof(hexData),
+                "hexData[][] must hold the whole memory");
+  static_assert(Device::pageSize + 1 <= sizeof(i2cBuffer),
+                "i2cBuffer must hold word address + 1 page");
+  int ans;
+  int total = pageCount(pageMask);
+  int done = 0;
+
+  // 失敗した場合は、このpageから続ける
+  resume.writeMask = pageMask;
+
+  // Write each byte of hexData[][] array to the chip
+  for (int i = 0; i < Device::pages; i++) {
+    if ((pageMask & (1 << i)) == 0) {
+      continue;
+    }
+    pc.progress("write", done++, total);
+    uint32_t start = traceStart();
+    int retry = 0;
+    bool nack;
+    bool fallback = false;
+
+    // NACK,ACK確認の失敗は待ち時間を延ばして同じpageをやり直す
+    // それでもNACKなら通信異常として1段階遅いclockで1回だけやり直す
+    do {
+      i2cBuffer[0] = i * Device::pageSize;
+      pc.printf("%02x: ", i);
+
+      for (int j = 0; j < Device::pageSize; j++) {
+        i2cBuffer[j + 1] = hexData[i][j];
+        pc.log(CONSOLE_VERBOSE, "%02x ", hexData[i][j]);
+      }
+      ans = Wire.write(control_code, i2cBuffer, Device::pageSize + 1);
+      Wire.wait_us(settleUs(SETTLE_GAP));
+      nack = (ans != 0);
+
+      if (ans != 0) {
+        pc.log(CONSOLE_QUIET, " nack\n");
+      } else {
+        pc.printf(" ack ");
+        ans = ackPolling(addressForAckPolling);
+      }
+    } while ((ans != 0) && (pageRetry(i, retry++, "write") ||
+                            busRetry(nack, &fallback)));
+
+    if (ans != 0) {
+      pc.log(CONSOLE_QUIET, "Oh No! Something went wrong while programming!\n");
+      Wire.stop();
+      return -1;
+    } else {
+      printAckPolling();
+      pc.printf("ready\n");
+      Wire.wait_us(settleUs(SETTLE_READY));
+      traceEnd(TRACE_WRITE, start, i);
+      resume.writeMask &= ~(1 << i);
+    }
+  }
+  pc.progress("write", done, total);
+
+  Wire.stop();
+  return 0;
+}
+
+int writePages(int control_code, int addressForAckPolling, uint16_t pageMask) {
+  DEVICE_DISPATCH(writePages, (control_code, addressForAckPolling, pageMask));
+}
+
+//*************************************
+/**
+ * 内容の異なるpageの検索
+ *
+ * @param[in] uint8_t now[16][16]: GreenPakから読み出した内容
+ * @param[in] uint8_t next[16][16]: 書き込む内容
+ * @return 内容の異なるpage(bit0=page0 ～ bit15=page15)
+ */
+//*************************************
+uint16_t diffPages(uint8_t now[16][16], uint8_t next[16][16]) {
+  uint16_t pageMask = 0;
+  for (int i = 0; i < 16; i++) {
+    if (memcmp(now[i], next[i], 16) != 0) {
+      pageMask |= (1 << i);
+    }
+  }
+  return pageMask;
+}
+
+/**
+ * 書き込みの続きの情報の初期化
+ *
+ * 書き込むpageは全てクリアが必要として始め、erasePages()が実際にクリアする
+ * pageに置き換える。書き込みデータはslave addressを差し替えた後のhexData[][]
+ */
+static void resumeBegin(greenPakMemory_t memoryType, int nextSlaveAddress,
+                        uint16_t pageMask) {
+  resume.pending = false;
+  resume.memoryType = memoryType;
+  resume.nextSlaveAddress = nextSlaveAddress;
+  resume.eraseMask = (memoryType == RESISTER) ? 0 : pageMask;
+  resume.writeMask = pageMask;
+  resume.failedPage = -1;
+  memset(resume.retries, 0x00, sizeof(resume.retries));
+  memcpy(resume.data, hexData, sizeof(resume.data));
+}
+
+/**
+ * erase後の安定待ち(これが無いとこの後の書き込みでエラーになる)
+ */
+static void eraseSettle(void) {
+  uint32_t start = traceStart();
+  Wire.wait_us(settleUs(SETTLE_ERASE));
+  traceEnd(TRACE_SETTLE, start);
+}
+
+/**
+ * resume.writeMaskのpageの書き込みと、書き込み後のpowercycle,確認
+ *
+ * 失敗した場合は、書きかけのpageをクリアし直してから続けるように記録する
+ * @return 0:正常終了 -1:異常終了
+ */
+template <class Device> static int writeFinish(greenPakDevice_t *dev) {
+  greenPakMemory_t memoryType = resume.memoryType;
+  int control_code =
+      (dev->slaveAddress << 4) | Device::blockConfig(memoryType);
+  int addressForAckPolling = dev->slaveAddress << 4;
+  if (writePages<Device>(control_code, addressForAckPolling,
+                         resume.writeMask) != 0) {
+    if (memoryType != RESISTER) {
+      resume.eraseMask |= 1 << resume.failedPage;
+    }
+    resume.pending = true;
+    pc.log(CONSOLE_QUIET, "page 0x%02x write NG (wc: resume)\n",
+           resume.failedPage);
+    return -1;
+  }
+  resume.pending = false;
+
+  // NVMを書き換えたら再起動させて動作に反映させる
+  if (memoryType == NVM) {
+    powercycle<Device>(dev);
+    if (resume.nextSlaveAddress != dev->slaveAddress) {
+      // 再起動でslave addressが切り替わる
+      deviceInvalidate(dev);
+    }
+  }
+
+  // 書き込んだ内容と比較する(書き込み後にfileが変わっても影響しない)
+  if (autoVerify) {
+    return verifyImage(dev, memoryType, resume.data);
+  }
+  return 0;
+}
+
+//*************************************
+/**
+ * 指示memory領域への書き込み指示
+ *
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示 　
+ * @param[in] int NVM書き込み時にslave addressを変更する場合に指示(NVMのみ必要)
+ * つけなければ現状と同じaddressを設定する
+ * @param[in] bool diff: true:現在の内容と比較して、変わったpageだけを書き込む
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+template <class Device>
+static int writeChip(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                     int nextSlaveAddress, bool diff) {
+  // NVMのslave address(0xCA)のhexData[][]での位置
+  uint8_t &slaveAddressByte = hexData[Device::regSlaveAddress / Device::pageSize]
+                                     [Device::regSlaveAddress % Device::pageSize];
+  int ans;
+
+  if (!Device::hasEeprom && (memoryType == EEPROM)) {
+    pc.log(CONSOLE_QUIET, "%s has no EEPROM\n", Device::name());
+    return -1;
+  }
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  uint8_t nowSlaveAddress = dev->slaveAddress;
+
+  pc.printf("slave address =  0x%02x\n", nowSlaveAddress);
+
+  printMemoryType(memoryType);
+
+  if (memoryType == NVM) {
+    resister_unprotect<Device>(dev);
+  }
+  pc.printf("\n");
+
+  if (memoryType == NVM) {
+    // 指示がなければimage fileの指定(.gpb), それもなければ現状のaddressにする
+    if ((nextSlaveAddress < 0x00) || (0x0f < nextSlaveAddress)) {
+      nextSlaveAddress =
+          (imageSlaveAddress <= 0x0f) ? imageSlaveAddress : nowSlaveAddress;
+    }
+    pc.printf("next slave address = 0x%02x\n", nextSlaveAddress);
+
+    // nextSlaveAddressに設定されている値に差し替える
+    // レジスタアドレス=0xcaのbit3-0 にI2C slave address を設定する
+    // bit7-4:
+    // 0にすると下位4bitのアドレスが有効になる(1にするとIO2,3,4,5の端子状態がアドレスになる)
+    //
+    // レジスタを書き換える場合にはslave address の書き換えは行わない
+    // この場合に書き換えると、この直後からアドレスが切り替わりその後の書き込みができなくなる
+    slaveAddressByte = (slaveAddressByte & 0xF0) | nextSlaveAddress;
+  } else if (memoryType == RESISTER) {
+    slaveAddressByte = (slaveAddressByte & 0xF0) | nowSlaveAddress;
+  }
+
+  // 差分書き込み: 内容が変わったpageだけをクリア,書き込みする
+  uint16_t pageMask = (1 << Device::pages) - 1;
+  if (diff) {
+    if (memoryType == EEPROM) {
+      resister_unprotect<Device>(dev);
+    }
+    if (readBlock<Device>(nowSlaveAddress, memoryType, chipData) != 0) {
+      pc.log(CONSOLE_QUIET, "read NG\n");
+      return -1;
+    }
+    pageMask = diffPages(chipData, hexData);
+    pc.printf("changed pages = 0x%04x\n", pageMask);
+    if (pageMask == 0) {
+      pc.printf("no change\n");
+      return 0;
+    }
+  }
+
+  // 途中で失敗した場合に、writeResume()で残りのpageから続けられるようにする
+  resumeBegin(memoryType, nextSlaveAddress, pageMask);
+
+  // erase
+  if (memoryType != RESISTER) {
+    pc.printf("erase start\n");
+    if (diff) {
+      // 途中でpowercycleするとNVMの0xCA(slave address)が再読込されるので、
+      // powercycleは書き込み完了後の1回だけにする
+      resister_unprotect<Device>(dev);
+      ans = erasePages<Device>(dev, memoryType, pageMask);
+    } else {
+      // NVMをクリアするとpowercycleでslave addressが変わるので確認し直す
+      ans = eraseChip<Device>(dev, memoryType);
+      if (ans == 0) {
+        ans = deviceOpen(dev);
+      }
+    }
+    if (ans == 0) {
+      resume.eraseMask = 0;
+      eraseSettle();
+      pc.printf("erase OK\n");
+    } else {
+      pc.log(CONSOLE_QUIET, "erase NG\n");
+      resume.pending = true;
+      return -1;
+    }
+  } else {
+    pc.printf("RESISTER don't erase area\n");
+  }
+
+  return writeFinish<Device>(dev);
+}
+
+/**
+ * 書き込みデータを読み込んでから、型番を決めて書き込む
+ *
+ * 書き込みデータ(.gpb)に型番の指定があれば、その型番として書き込む
+ */
+int writeChip(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+              int nextSlaveAddress, bool diff) {
+  // RESISTERにはNVM用のデータを書き込む
+  if (imageRead((memoryType == EEPROM) ? EEPROM : NVM) != 256) {
+    return -1;
+  }
+  DEVICE_DISPATCH(writeChip, (dev, memoryType, nextSlaveAddress, diff));
+}
+
+//*************************************
+/**
+ * 途中で失敗した書き込みの続き
+ *
+ * 失敗したpageから(クリアの途中であればクリアから)続ける。書き込み済みのpageと
+ * 書き込みデータの読み込みはやり直さない。次の書き込み,クリアまで続けられる
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @return 0:正常終了 -1:異常終了,続きがない
+ */
+//*************************************
+template <class Device> static int writeResume(greenPakDevice_t *dev) {
+  greenPakMemory_t memoryType = resume.memoryType;
+
+  if (!resume.pending) {
+    pc.log(CONSOLE_QUIET, "no write to resume\n");
+    return -1;
+  }
+  if (!Device::hasEeprom && (memoryType == EEPROM)) {
+    pc.log(CONSOLE_QUIET, "%s has no EEPROM\n", Device::name());
+    return -1;
+  }
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  pc.printf("slave address =  0x%02x\n", dev->slaveAddress);
+  printMemoryType(memoryType);
+  pc.log(CONSOLE_QUIET, "resume: erase 0x%04x, write 0x%04x\n",
+         resume.eraseMask, resume.writeMask);
+
+  memcpy(hexData, resume.data, sizeof(hexData));
+  if (memoryType != RESISTER) {
+    resister_unprotect<Device>(dev);
+  }
+  if (resume.eraseMask != 0) {
+    if (erasePages<Device>(dev, memoryType, resume.eraseMask) != 0) {
+      pc.log(CONSOLE_QUIET, "erase NG\n");
+      return -1;
+    }
+    eraseSettle();
+    pc.printf("erase OK\n");
+  }
+  return writeFinish<Device>(dev);
+}
+
+int writeResume(greenPakDevice_t *dev) {
+  DEVICE_DISPATCH(writeResume, (dev));
+}
+
+//*************************************
+/**
+ * 直前の書き込みのpageごとのretry回数と、続きの有無の表示
+ */
+//*************************************
+void writeResumePrint(void) {
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    if (resume.retries[i] != 0) {
+      pc.log(CONSOLE_QUIET, "page 0x%02x: %d retries%s\n", i,
+             resume.retries[i], (i == resume.failedPage) ? " (failed)" : "");
+      total += resume.retries[i];
+    }
+  }
+  pc.log(CONSOLE_QUIET, "retry %d times, backoff %luus: %d retries\n",
+         pageRetries, (unsigned long)pageBackoffUs, total);
+  if (resume.pending) {
+    pc.log(CONSOLE_QUIET, "resume: %s erase 0x%04x, write 0x%04x (wc)\n",
+           (resume.memoryType == EEPROM)
+               ? "EEPROM"
+               : ((resume.memoryType == NVM) ? "NVM" : "RESISTER"),
+           resume.eraseMask, resume.writeMask);
+  }
+}
+
+//*************************************
+/**
+ * 指示memory領域の読み出し(PCへの表示なし)
+ *
+ * word address 0x00を1回だけ設定し、address自動加算で256byteを続けて読み出す
+ * (Z_readChunk byteずつのI2C readに分ける. 間にword addressの設定,待ち時間はない)
+ * 読み出し内容の表示,確認(readChip(),verifyChip()など)はこの結果を使う
+ * @param[in] int slaveAddress: 対象GreenPakのslave address
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @param[out] uint8_t data[16][16]: 読み出したデータ
+ * @return 0:正常終了 -1:異常終了(NACK)
+ */
+//*************************************
+template <class Device>
+static int readBlock(int slaveAddress, greenPakMemory_t memoryType,
+                     uint8_t data[16][16]) {
+  static_assert((Device::pages * Device::pageSize) % Z_readChunk == 0,
+                "Z_readChunk must divide the memory size");
+  if (!Device::hasEeprom && (memoryType == EEPROM)) {
+    return -1;
+  }
+  uint8_t control_code = (slaveAddress << 4) | Device::blockConfig(memoryType);
+  uint32_t start = traceStart();
+  char *p = (char *)&data[0][0];
+
+  i2cBuffer[0] = 0x00;
+  if (Wire.write(control_code, i2cBuffer, 1, true) != 0) {
+    Wire.stop();
+    return -1;
+  }
+  for (int offset = 0; offset < Device::pages * Device::pageSize;
+       offset += Z_readChunk) {
+    if (Wire.read(control_code, p + offset, Z_readChunk, true) != 0) {
+      Wire.stop();
+      return -1;
+    }
+  }
+  Wire.stop();
+  traceEnd(TRACE_READ, start);
+  return 0;
+}
+
+int readBlock(int slaveAddress, greenPakMemory_t memoryType,
+              uint8_t data[16][16]) {
+  DEVICE_DISPATCH(readBlock, (slaveAddress, memoryType, data));
+}
+
+//*************************************
+/**
+ * 指示memory領域からの読み込み指示
+ *
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示 　
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int readChip(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  int slaveAddress = dev->slaveAddress;
+
+  pc.printf("slave address =  0x%02x\n", slaveAddress);
+
+  printMemoryType(memoryType);
+
+  if (readBlock(slaveAddress, memoryType, chipData) != 0) {
+    pc.log(CONSOLE_QUIET, "nack\n");
+    return -1;
+  }
+
+  // 読み出し内容はcommandの結果なのでCONSOLE_QUIETでも表示する
+  for (int i = 0; i < 16; i++) {
+    pc.log(CONSOLE_QUIET, "%02x :", i);
+    for (int j = 0; j < 16; j++) {
+      pc.log(CONSOLE_QUIET, "%02x ", chipData[i][j]);
+    }
+    pc.log(CONSOLE_QUIET, "\n");
+  }
+  return 0;
+}
+
+//*************************************
+/**
+ * 指示memory領域のHEX fileへの保存
+ *
+ * 読み出した内容をhexFormat()でbuffer[]にHEX fileの形式で書き、1回のfwrite()で
+ * 保存する。保存したfileはhexFileRead()やGreenPAK Designerでそのまま読み込める
+ * file名はLocalFileSystemの8.3形式に合わせて RD_NVM.hex, RD_EEP.hex, RD_REG.hex
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int dumpChip(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  const char *name =
+      (memoryType == NVM)
+          ? "RD_NVM.hex"
+          : ((memoryType == EEPROM) ? "RD_EEP.hex" : "RD_REG.hex");
+
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  int slaveAddress = dev->slaveAddress;
+
+  pc.printf("slave address =  0x%02x\n", slaveAddress);
+
+  printMemoryType(memoryType);
+
+  if (memoryType == EEPROM) {
+    resister_unprotect(dev);
+  }
+  if (readBlock(slaveAddress, memoryType, chipData) != 0) {
+    pc.log(CONSOLE_QUIET, "nack\n");
+    return -1;
+  }
+
+  int length = hexFormat(chipData, buffer);
+  FILE *fp = localOpen(name, "w");
+  if (fp == NULL) {
+    pc.log(CONSOLE_QUIET, "dump: %s open error\n", name);
+    return -1;
+  }
+  int size = fwrite(buffer, 1, length, fp);
+  fclose(fp);
+  if (size != length) {
+    pc.log(CONSOLE_QUIET, "dump: %s write error\n", name);
+    return -1;
+  }
+
+  pc.log(CONSOLE_QUIET, "dump: %s 256 bytes crc=%08lx\n", name,
+         (unsigned long)crc32(chipData[0], 256));
+  return 0;
+}
+
+/**
+ * 読み出した内容と期待する内容の比較(結果はverifyLastに保存する)
+ */
+static void verifyCompare(const uint8_t *now, const uint8_t *next,
+                          int length) {
+  verifyLast.mismatches = 0;
+  for (int i = 0; i < length; i++) {
+    if (now[i] != next[i]) {
+      if (verifyLast.mismatches < Z_verifyList) {
+        verifyLast.offset[verifyLast.mismatches] = i;
+      }
+      verifyLast.mismatches++;
+    }
+  }
+  verifyLast.crc = crc32(now, length);
+  verifyLast.imageCrc = crc32(next, length);
+}
+
+/**
+ * GreenPakから読み出した内容と指示した内容の比較
+ *
+ * 不一致のaddressと読み出し内容のCRC32だけを表示する
+ * RESISTERは0xC0以降が制御,状態用のregisterなので0x00～0xBFだけを比較する
+ * 結果はverifyLastに保存する
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @param[in] const uint8_t expect[16][16]: 期待する内容
+ * @return 0:一致 -1:不一致,異常終了
+ */
+static int verifyImage(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                       const uint8_t expect[16][16]) {
+  memset(&verifyLast, 0x00, sizeof(verifyLast));
+
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  if (memoryType == EEPROM) {
+    resister_unprotect(dev);
+  }
+  int length = (memoryType == RESISTER) ? 0xC0 : 0x100;
+  const uint8_t *now = &chipData[0][0];
+  const uint8_t *next = &expect[0][0];
+  int hz = busHz;
+  int ans = readBlock(dev->slaveAddress, memoryType, chipData);
+  if (ans == 0) {
+    verifyCompare(now, next, length);
+  }
+
+  // NACK,不一致は1段階遅いclockで読み直す。NACKが直った,読み出し内容が変わった
+  // 場合だけ通信異常としてそのclockで比較し直す(内容が同じならclockを戻す)
+  if (((ans != 0) || (verifyLast.mismatches != 0)) && (busFallback() == 0)) {
+    uint8_t again[16][16];
+    if ((readBlock(dev->slaveAddress, memoryType, again) == 0) &&
+        ((ans != 0) || (memcmp(again, chipData, sizeof(again)) != 0))) {
+      memcpy(chipData, again, sizeof(chipData));
+      ans = 0;
+      verifyCompare(now, next, length);
+    } else {
+      busRestore(hz);
+    }
+  }
+  if (ans != 0) {
+    pc.log(CONSOLE_QUIET, "read NG\n");
+    return -1;
+  }
+
+  if (verifyLast.mismatches == 0) {
+    pc.log(CONSOLE_QUIET, "verify OK crc=%08lx\n", (unsigned long)verifyLast.crc);
+    return 0;
+  }
+
+  pc.log(CONSOLE_QUIET, "verify NG %d bytes crc=%08lx (image %08lx)\n",
+         verifyLast.mismatches, (unsigned long)verifyLast.crc,
+         (unsigned long)verifyLast.imageCrc);
+  for (int i = 0; (i < verifyLast.mismatches) && (i < Z_verifyList); i++) {
+    uint8_t address = verifyLast.offset[i];
+    pc.log(CONSOLE_QUIET, " %02x: %02x -> %02x\n", address, next[address],
+           now[address]);
+  }
+  if (verifyLast.mismatches > Z_verifyList) {
+    pc.log(CONSOLE_QUIET, " ...\n");
+  }
+  return -1;
+}
+
+//*************************************
+/**
+ * 指示memory領域の書き込み内容の確認
+ *
+ * GreenPakから読み出した内容を書き込みデータ(imageRead())と比較する
+ * slave address(0xCA)は現在のslave addressとして比較する
+ * (書き込み直後の確認は、書き込んだ内容(resume.data)と比較する. writeFinish())
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @return 0:一致 -1:不一致,異常終了
+ */
+//*************************************
+int verifyChip(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  memset(&verifyLast, 0x00, sizeof(verifyLast));
+
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  if (imageRead(memoryType) != 256) {
+    return -1;
+  }
+  if (memoryType != EEPROM) {
+    hexData[0xC][0xA] = (hexData[0xC][0xA] & 0xF0) | dev->slaveAddress;
+  }
+  return verifyImage(dev, memoryType, hexData);
+}
+
+//=====================================
+// 処理後の待ち時間
+//=====================================
+static const uint32_t settleDefaultUs[SETTLE_KINDS] = {
+    Z_settlePingUs, Z_settleGapUs, Z_settleReadyUs, Z_settleEraseUs};
+static const char *const settleNames[SETTLE_KINDS] = {"ping", "gap", "ready",
+                                                      "erase"};
+
+/**
+ * 使用する待ち時間
+ *
+ * 測定した値(settle.calibrated)にはsettle.marginPct[%]を加える
+ * @param[in] settleKind_t kind: 待ち時間の種類
+ * @return 待ち時間[us]
+ */
+uint32_t settleUs(settleKind_t kind) {
+  uint32_t us = settle.us[kind];
+  if (settle.calibrated) {
+    us += us * settle.marginPct / 100;
+  }
+  return us;
+}
+
+/**
+ * 待ち時間を初期値(以前の固定値)に戻す
+ */
+void settleDefault(void) {
+  settle.calibrated = false;
+  settle.marginPct = Z_settleMarginPct;
+  memcpy(settle.us, settleDefaultUs, sizeof(settle.us));
+}
+
+//*************************************
+/**
+ * 待ち時間の読み込み(/local/SETTLE.txt)
+ *
+ * 1行に "名前 値" ("ping","gap","ready","erase"[us], "margin"[%],
+ * "calibrated" 1:測定値)。#で始まる行と知らない名前は読み飛ばす
+ * @return 0:正常終了 -1:fileがない(初期値のまま)
+ */
+//*************************************
+int settleLoad(void) {
+  char text[64];
+  char name[16];
+  unsigned long value;
+
+  FILE *fp = localOpen(Z_settleFile, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  settleDefault();
+  while (fgets(text, sizeof(text), fp) != NULL) {
+    if ((text[0] == '#') || (sscanf(text, "%15s %lu", name, &value) != 2)) {
+      continue;
+    }
+    if (strcmp(name, "calibrated") == 0) {
+      settle.calibrated = (value != 0);
+    } else if (strcmp(name, "margin") == 0) {
+      settle.marginPct = value;
+    }
+    for (int i = 0; i < SETTLE_KINDS; i++) {
+      if (strcmp(name, settleNames[i]) == 0) {
+        settle.us[i] = value;
+      }
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * 待ち時間の保存(/local/SETTLE.txt)
+ *
+ * @return 0:正常終了 -1:fileを作れない
+ */
+int settleSave(void) {
+  FILE *fp = localOpen(Z_settleFile, "w");
+  if (fp == NULL) {
+    pc.log(CONSOLE_QUIET, "%s write NG\n", Z_settleFile);
+    return -1;
+  }
+  fprintf(fp, "# settle profile [us] (oc: calibrate)\n");
+  fprintf(fp, "calibrated %d\n", settle.calibrated ? 1 : 0);
+  fprintf(fp, "margin %lu\n", (unsigned long)settle.marginPct);
+  for (int i = 0; i < SETTLE_KINDS; i++) {
+    fprintf(fp, "%s %lu\n", settleNames[i], (unsigned long)settle.us[i]);
+  }
+  fclose(fp);
+  pc.printf("%s saved\n", Z_settleFile);
+  return 0;
+}
+
+/**
+ * 調整中の1回分の書き込み,確認
+ *
+ * 失敗した場合は書きかけの内容でslave addressが変わっていることがあるので、
+ * 次の書き込みではGreenPakを探し直す
+ * @return 0:正常終了 -1:異常終了
+ */
+static int settleTrial(greenPakDevice_t *dev, greenPakMemory_t memoryType) {
+  for (int i = 0; i < Z_settleRuns; i++) {
+    if (writeChip(dev, memoryType) != 0) {
+      deviceInvalidate(dev);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * 1つの待ち時間の調整
+ *
+ * 半分にしながら確認し、最後に成功した値の1段階上(2倍)を残す
+ * (Z_settleMinUsより短くする場合は0で試す). Z_settleRuns回の成功だけでは
+ * 最短の値は確実とは言えないので余裕を持たせる
+ * @param[in] settleKind_t kind: 調整する待ち時間
+ * @param[in] uint16_t present: SETTLE_PINGの確認に使う応答したControl Code
+ */
+static void settleSearch(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                         settleKind_t kind, uint16_t present) {
+  uint32_t us = settle.us[kind];
+  uint32_t safe = us; //<! 最後に成功した値の1段階上
+
+  while (us > 0) {
+    uint32_t next = (us / 2 < Z_settleMinUs) ? 0 : us / 2;
+    settle.us[kind] = next;
+    int ans = 0;
+    if (kind == SETTLE_PING) {
+      for (int i = 0; (ans == 0) && (i < Z_settleRuns); i++) {
+        ans = (pingScan() == present) ? 0 : -1;
+      }
+    } else {
+      ans = settleTrial(dev, memoryType);
+    }
+    pc.log(CONSOLE_QUIET, "%-5s %7luus %s\n", settleNames[kind],
+           (unsigned long)next, (ans == 0) ? "OK" : "NG");
+    if (ans != 0) {
+      break;
+    }
+    safe = us;
+    us = next;
+  }
+  settle.us[kind] = safe;
+  pc.log(CONSOLE_QUIET, "%-5s %7luus (shortest OK %luus)\n", settleNames[kind],
+         (unsigned long)safe, (unsigned long)us);
+}
+
+//*************************************
+/**
+ * 待ち時間の調整
+ *
+ * 接続したGreenPakに書き込み(クリア,書き込み,確認)を繰り返し、待ち時間ごとに
+ * 初期値から半分にしながら、Z_settleRuns回続けて成功する最短の値を測る
+ * (ping()の間隔は全Control Codeの応答が変わらない最短の値)
+ * 測定中はretryなし,書き込み後の確認あり,I2C clock固定にし、失敗を待ち時間の
+ * 不足として扱う。最後にmarginを加えた値で書き込み,確認できれば測定値にする
+ * 1回の調整で約40回書き換えるので、EEPROMで調整する。書き換え回数に制限のある
+ * NVMでは、nvmConfirmedで指示された場合だけ調整する
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM 書き込みに使う領域(NVM.hex,EEPROM.hex)
+ * @param[in] bool nvmConfirmed: true:NVMでの調整を許可する
+ * @return 0:正常終了 -1:異常終了(初期値で書き込めない,NVMの許可なし.
+ * 待ち時間は元のまま)
+ */
+//*************************************
+int settleCalibrate(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+                    bool nvmConfirmed) {
+  // 影響の大きい(回数の多い)待ち時間から調整する
+  static const settleKind_t order[SETTLE_KINDS] = {SETTLE_READY, SETTLE_ERASE,
+                                                   SETTLE_GAP, SETTLE_PING};
+
+  if (memoryType == RESISTER) {
+    return -1;
+  }
+  if ((memoryType == NVM) && !nvmConfirmed) {
+    pc.log(CONSOLE_QUIET, "calibrate on NVM wears it out (use EEPROM)\n");
+    return -1;
+  }
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  settleProfile_t saved = settle;
+  int retries = pageRetries;
+  bool verify = autoVerify;
+  int pinnedHz = busPinnedHz;
+  pageRetries = 0;
+  autoVerify = true;
+  busPinnedHz = busHz;
+
+  settleDefault();
+  settle.marginPct = saved.marginPct;
+  uint16_t present = pingScan();
+  int ans = settleTrial(dev, memoryType);
+  if (ans != 0) {
+    pc.log(CONSOLE_QUIET, "default settle NG\n");
+  }
+  for (int i = 0; (ans == 0) && (i < SETTLE_KINDS); i++) {
+    settleSearch(dev, memoryType, order[i], present);
+  }
+
+  // marginを加えた値で確認する
+  if (ans == 0) {
+    settle.calibrated = true;
+    ans = writeChip(dev, memoryType);
+    if (ans != 0) {
+      pc.log(CONSOLE_QUIET, "calibrated settle NG\n");
+    }
+  }
+  if (ans != 0) {
+    settle = saved;
+  }
+
+  pageRetries = retries;
+  autoVerify = verify;
+  busPinnedHz = pinnedHz;
+  settlePrint();
+  return ans;
+}
+
+/**
+ * 待ち時間の表示
+ */
+void settlePrint(void) {
+  pc.log(CONSOLE_QUIET, "settle %s, margin %lu%%\n",
+         settle.calibrated ? "calibrated" : "default",
+         (unsigned long)settle.marginPct);
+  for (int i = 0; i < SETTLE_KINDS; i++) {
+    pc.log(CONSOLE_QUIET, "%-5s %7luus (use %luus, default %luus)\n",
+           settleNames[i], (unsigned long)settle.us[i],
+           (unsigned long)settleUs((settleKind_t)i),
+           (unsigned long)settleDefaultUs[i]);
+  }
+}
+
+//=====================================
+// 複数GreenPakへの一括書き込み
+//=====================================
+/**
+ * 一括書き込み対象のGreenPak
+ */
+typedef struct {
+  greenPakDevice_t dev; //<! 操作対象GreenPak
+  int result;           //<! 0:正常 -1:異常
+  const char *phase;    //<! 異常になった処理
+  uint16_t erased;      //<! クリアしたpage数
+  uint16_t written;     //<! 書き込んだpage数
+  uint16_t retries;     //<! pageをやり直した回数
+  uint32_t busyUs;      //<! ACK待ち時間の合計[us]
+} gangDevice_t;
+
+static gangDevice_t gang[16];
+static int gangCount = 0;
+
+/**
+ * 一括書き込み対象GreenPakの異常終了
+ */
+static void gangFail(gangDevice_t *g, const char *phase) {
+  if (g->result == 0) {
+    g->result = -1;
+    g->phase = phase;
+  }
+}
+
+/**
+ * 全GreenPakのACK確認
+ *
+ * 先頭から順にACKを確認する。後ろのGreenPakほど待つ間に処理が進んでいる
+ * @param[in] bool active[]: 確認対象(操作指示をした)GreenPak
+ * @param[in,out] bool failed[]: ACKが返らなかったGreenPakをtrueにする
+ */
+static void gangAckPolling(const bool active[], bool failed[]) {
+  for (int i = 0; i < gangCount; i++) {
+    if (!active[i]) {
+      continue;
+    }
+    gangDevice_t *g = &gang[i];
+    if (ackPolling(g->dev.slaveAddress << 4) != 0) {
+      failed[i] = true;
+    }
+    g->busyUs += ackPollLast.elapsedUs;
+  }
+}
+
+/**
+ * 1つのGreenPakへのpage erase,page writeの指示
+ *
+ * @param[in] bool erase: true:page erase false:page write
+ * @param[in] uint8_t slaveAddressBase: NVMの0xCAの上位4bit(page writeのみ)
+ * @return 0:ACK 0以外:NACK(page eraseはerrataのため常に0)
+ */
+template <class Device>
+static int gangIssue(gangDevice_t *g, greenPakMemory_t memoryType, int page,
+                     bool erase, uint8_t slaveAddressBase) {
+  if (erase) {
+    i2cBuffer[0] = Device::regPageErase;
+    i2cBuffer[1] = Device::pageErase(memoryType, page);
+    Wire.write((g->dev.slaveAddress << 4) | Device::resisterConfig, i2cBuffer,
+               2);
+    return 0;
+  }
+  const int slavePage = Device::regSlaveAddress / Device::pageSize;
+  const int slaveOffset = Device::regSlaveAddress % Device::pageSize;
+  i2cBuffer[0] = page * Device::pageSize;
+  memcpy(&i2cBuffer[1], hexData[page], Device::pageSize);
+  if ((page == slavePage) && (memoryType != EEPROM)) {
+    i2cBuffer[1 + slaveOffset] = slaveAddressBase | g->dev.slaveAddress;
+  }
+  int control_code =
+      (g->dev.slaveAddress << 4) | Device::blockConfig(memoryType);
+  return Wire.write(control_code, i2cBuffer, Device::pageSize + 1);
+}
+
+/**
+ * 失敗したGreenPakのpageのやり直し
+ *
+ * writePages()と同じく、待ち時間をpageBackoffUsから倍にしながら
+ * そのGreenPakだけでpageRetries回までやり直す
+ * @return 0:正常終了 -1:retry回数を使い切った
+ */
+template <class Device>
+static int gangRetry(gangDevice_t *g, greenPakMemory_t memoryType, int page,
+                     bool erase, uint8_t slaveAddressBase) {
+  for (int retry = 0; retry < pageRetries; retry++) {
+    uint32_t us = pageBackoffUs << retry;
+    pc.log(CONSOLE_QUIET, "0x%02x page 0x%02x %s retry %d (%luus)\n",
+           g->dev.slaveAddress, page, erase ? "erase" : "write", retry + 1,
+           (unsigned long)us);
+    Wire.stop();
+    Wire.wait_us(us);
+    g->retries++;
+    if (gangIssue<Device>(g, memoryType, page, erase, slaveAddressBase) != 0) {
+      continue;
+    }
+    if (!erase) {
+      Wire.wait_us(settleUs(SETTLE_GAP));
+    }
+    int ans = ackPolling(g->dev.slaveAddress << 4);
+    g->busyUs += ackPollLast.elapsedUs;
+    if (ans == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * 全GreenPakへの1page分のpage erase,page write
+ *
+ * 全GreenPakに指示してからACKを確認し、失敗したGreenPakだけをやり直す
+ * @param[in] bool active[]: 指示するGreenPak
+ * @param[in] bool erase: true:page erase false:page write
+ */
+template <class Device>
+static void gangPage(const bool active[], greenPakMemory_t memoryType,
+                     int page, bool erase, uint8_t slaveAddressBase) {
+  bool issued[16];
+  bool failed[16];
+
+  for (int i = 0; i < gangCount; i++) {
+    issued[i] = active[i];
+    failed[i] = false;
+    if (active[i] && (gangIssue<Device>(&gang[i], memoryType, page, erase,
+                                        slaveAddressBase) != 0)) {
+      issued[i] = false;
+      failed[i] = true;
+    }
+  }
+  if (!erase) {
+    Wire.wait_us(settleUs(SETTLE_GAP));
+  }
+  gangAckPolling(issued, failed);
+
+  for (int i = 0; i < gangCount; i++) {
+    gangDevice_t *g = &gang[i];
+    if (!active[i]) {
+      continue;
+    }
+    if (failed[i] &&
+        (gangRetry<Device>(g, memoryType, page, erase, slaveAddressBase) != 0)) {
+      gangFail(g, erase ? "erase" : "write");
+    } else if (erase) {
+      g->erased++;
+    } else {
+      g->written++;
+    }
+  }
+  Wire.wait_us(settleUs(SETTLE_READY));
+}
+
+//*************************************
+/**
+ * 接続されている全GreenPakへの一括書き込み
+ *
+ * ping()と同じように全Control Codeを確認し、応答した全GreenPakに同じデータを書き込む
+ * pageごとに全GreenPakへ順にクリア,書き込みを指示してからACKを確認するので、
+ * 1つのGreenPakがbusy(tER,tWR)の間に他のGreenPakへの通信が進む
+ * 全pageのクリアを終えてから1回だけ安定待ちして書き込む(writeChip()と同じ待ち時間)
+ * 途中でpowercycleするとNVMをクリアしたGreenPakのslave addressが
+ * 同じ(0x00)になるので、powercycleは書き込み完了後に行う
+ * NVMのslave address(0xCA)はそれぞれ現在のaddressを書き込む
+ * 最後にGreenPakごとの結果を表示する
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @param[in] int excludeAddress: 書き込まないGreenPakのslave address
+ * (複製元など. -1:全てに書き込む)
+ * @return 0:全て正常終了 -1:異常終了あり
+ */
+//*************************************
+template <class Device>
+static int gangWrite(greenPakMemory_t memoryType, int excludeAddress) {
+  // NVMのslave address(0xCA)のhexData[][]での位置
+  const int slavePage = Device::regSlaveAddress / Device::pageSize;
+  const int slaveOffset = Device::regSlaveAddress % Device::pageSize;
+  bool active[16];
+  uint32_t start = Wire.read_us();
+
+  resume.pending = false;
+
+  if (!Device::hasEeprom && (memoryType == EEPROM)) {
+    pc.log(CONSOLE_QUIET, "%s has no EEPROM\n", Device::name());
+    return -1;
+  }
+
+  // 接続されているGreenPakの検索
+  gangCount = 0;
+  memset(gang, 0x00, sizeof(gang));
+  for (int i = 0; i < 16; i++) {
+    int control_code = (i << 4) | Device::resisterConfig;
+    if ((i != excludeAddress) && (Wire.read(control_code, i2cBuffer, 0) == 0)) {
+      gangDevice_t *g = &gang[gangCount++];
+      g->dev.valid = true;
+      g->dev.slaveAddress = i;
+      g->phase = "";
+    }
+  }
+  if (gangCount == 0) {
+    pc.log(CONSOLE_QUIET, "not found IC\n");
+    return -1;
+  }
+  pc.printf("%d devices\n", gangCount);
+
+  printMemoryType(memoryType);
+
+  // RESISTERにはNVM用のデータを書き込む
+  if (imageRead((memoryType == EEPROM) ? EEPROM : NVM) != 256) {
+    return -1;
+  }
+  uint8_t slaveAddressBase = hexData[slavePage][slaveOffset] & 0xF0;
+
+  // protect解除とクリアが必要なpageの確認
+  uint16_t eraseMask[16];
+  uint16_t eraseAny = 0;
+  for (int i = 0; i < gangCount; i++) {
+    gangDevice_t *g = &gang[i];
+    eraseMask[i] = 0;
+    if (memoryType == RESISTER) {
+      continue;
+    }
+    resister_unprotect<Device>(&g->dev);
+    if (readBlock<Device>(g->dev.slaveAddress, memoryType, chipData) != 0) {
+      gangFail(g, "read");
+      continue;
+    }
+    eraseMask[i] = ~blankPages(chipData);
+    eraseAny |= eraseMask[i];
+  }
+
+  // erase: pageごとに全GreenPakにpage eraseを指示してからACKを確認する
+  for (int page = 0; page < Device::pages; page++) {
+    pc.progress("erase", page, Device::pages);
+    bool any = false;
+    for (int i = 0; i < gangCount; i++) {
+      active[i] = (gang[i].result == 0) && (eraseMask[i] & (1 << page));
+      any |= active[i];
+    }
+    if (any) {
+      gangPage<Device>(active, memoryType, page, true, slaveAddressBase);
+    }
+  }
+  pc.progress("erase", Device::pages, Device::pages);
+  if (eraseAny != 0) {
+    eraseSettle();
+  }
+
+  // write: pageごとに全GreenPakにpage writeを指示してからACKを確認する
+  for (int page = 0; page < Device::pages; page++) {
+    pc.progress("write", page, Device::pages);
+    pc.log(CONSOLE_VERBOSE, "page 0x%02x\n", page);
+    for (int i = 0; i < gangCount; i++) {
+      active[i] = (gang[i].result == 0);
+    }
+    gangPage<Device>(active, memoryType, page, false, slaveAddressBase);
+  }
+  Wire.stop();
+  pc.progress("write", Device::pages, Device::pages);
+
+  // NVMを書き換えたら再起動させて動作に反映させる
+  for (int i = 0; i < gangCount; i++) {
+    gangDevice_t *g = &gang[i];
+    if ((memoryType == NVM) && (g->result == 0)) {
+      powercycle<Device>(&g->dev);
+    }
+  }
+  if (autoVerify) {
+    // 再起動後もそれぞれのslave addressで応答することを確かめてから確認する
+    for (int i = 0; i < gangCount; i++) {
+      gangDevice_t *g = &gang[i];
+      if (g->result != 0) {
+        continue;
+      }
+      int control_code = (g->dev.slaveAddress << 4) | Device::resisterConfig;
+      if (Wire.read(control_code, i2cBuffer, 0) != 0) {
+        gangFail(g, "open");
+        continue;
+      }
+      if (memoryType != EEPROM) {
+        hexData[slavePage][slaveOffset] =
+            slaveAddressBase | g->dev.slaveAddress;
+      }
+      if (verifyImage(&g->dev, memoryType, hexData) != 0) {
+        gangFail(g, "verify");
+      }
+    }
+  }
+  deviceInvalidate(&session);
+
+  // 結果表示
+  int ng = 0;
+  pc.log(CONSOLE_QUIET, "addr result erased written retry busy[ms]\n");
+  for (int i = 0; i < gangCount; i++) {
+    gangDevice_t *g = &gang[i];
+    pc.log(CONSOLE_QUIET, "0x%02x %-6s %6d %7d %5d %8lu %s\n",
+           g->dev.slaveAddress, (g->result == 0) ? "OK" : "NG", g->erased,
+           g->written, g->retries, (unsigned long)(g->busyUs / 1000),
+           g->phase);
+    if (g->result != 0) {
+      ng++;
+    }
+  }
+  pc.log(CONSOLE_QUIET, "%d devices, %d NG, %lums\n", gangCount, ng,
+         (unsigned long)((Wire.read_us() - start) / 1000));
+  return (ng == 0) ? 0 : -1;
+}
+
+int gangWrite(greenPakMemory_t memoryType, int excludeAddress) {
+  DEVICE_DISPATCH(gangWrite, (memoryType, excludeAddress));
+}
+
+//=====================================
+// 複製
+//=====================================
+//*************************************
+/**
+ * 複製元GreenPakの内容を書き込みデータにする
+ *
+ * 複製元から読み出した内容をRAM上のimage(ramImage[])にする。HEX fileの読み込み,
+ * 変換は行わない。imageはhfで破棄するまで以後の書き込み(wn,we,m,me,gnなど)で使う
+ * 他のControl CodeのGreenPakが接続されていれば、そのままgangWrite()で書き込む
+ * NVMのslave address(0xCA)は書き込み先の現在のaddressのままにする
+ * @param[in] greenPakMemory_t NVM,EEPROM 対象領域の指示
+ * @param[in] int goldenAddress: 複製元のslave address(0x00～0x0f,
+ * それ以外:操作対象のGreenPak(session))
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int cloneChip(greenPakMemory_t memoryType, int goldenAddress) {
+  greenPakDevice_t other = {};
+  greenPakDevice_t *golden = &session;
+
+  if ((0x00 <= goldenAddress) && (goldenAddress <= 0x0f)) {
+    if (Wire.read((goldenAddress << 4) | RESISTER_CONFIG, i2cBuffer, 0) != 0) {
+      pc.log(CONSOLE_QUIET, "clone: not found 0x%02x\n", goldenAddress);
+      return -1;
+    }
+    other.valid = true;
+    other.slaveAddress = goldenAddress;
+    golden = &other;
+  } else if (deviceOpen(&session) != 0) {
+    return -1;
+  }
+
+  printMemoryType(memoryType);
+
+  ramImage_t *ram = &ramImage[(memoryType == EEPROM) ? 1 : 0];
+  ram->valid = false;
+  if (memoryType == EEPROM) {
+    resister_unprotect(golden);
+  }
+  if (readBlock(golden->slaveAddress, memoryType, ram->data) != 0) {
+    pc.log(CONSOLE_QUIET, "clone: read NG\n");
+    return -1;
+  }
+  ram->slaveAddress = 0xff; // 書き込み先のaddressを継承する
+  ram->deviceId = deviceType;
+  ram->pages = 0xffff;
+  ram->valid = true;
+  pc.log(CONSOLE_QUIET, "clone: golden 0x%02x crc=%08lx\n", golden->slaveAddress,
+         (unsigned long)crc32(ram->data[0], 256));
+
+  // 他のGreenPakが接続されていれば書き込む
+  int others = 0;
+  for (int i = 0; i < 16; i++) {
+    if ((i != golden->slaveAddress) &&
+        (Wire.read((i << 4) | RESISTER_CONFIG, i2cBuffer, 0) == 0)) {
+      others++;
+    }
+  }
+  if (others == 0) {
+    pc.log(CONSOLE_QUIET, "clone: image in RAM (next part: w%c, m%s / hf: "
+                          "discard)\n",
+           (memoryType == EEPROM) ? 'e' : 'n',
+           (memoryType == EEPROM) ? "e" : "");
+    return 0;
+  }
+  return gangWrite(memoryType, golden->slaveAddress);
+}
+
+//=====================================
+// 量産モード
+//=====================================
+productionStats_t production = {}; //<! 量産モードの集計
+
+static bool productionEeprom = false; //<! true:EEPROMも書き込む
+static uint8_t productionLoaded =
+    0; //<! 量産モード用にRAMへ読み込んだimage(bit0:NVM bit1:EEPROM)
+
+//*************************************
+/**
+ * 量産モードの開始
+ *
+ * 書き込みデータを先にRAM(ramImage[])へ読み込んでおき、1個ごとのfile読み込みをなくす
+ * PCから転送済みのimageがあればそれを使う
+ * @param[in] bool eeprom: true:NVMとEEPROMに書き込む false:NVMだけに書き込む
+ * @return 0:正常終了 -1:書き込みデータがない
+ */
+//*************************************
+int productionBegin(bool eeprom) {
+  productionEeprom = eeprom;
+  productionLoaded = 0;
+
+  for (int i = 0; i < (eeprom ? 2 : 1); i++) {
+    ramImage_t *ram = &ramImage[i];
+    if (ram->valid) {
+      continue;
+    }
+    if (imageRead((i == 0) ? NVM : EEPROM) != 256) {
+      productionEnd();
+      return -1;
+    }
+    memcpy(ram->data, hexData, sizeof(ram->data));
+    ram->slaveAddress = imageSlaveAddress;
+    ram->pages = 0xffff;
+    ram->valid = true;
+    productionLoaded |= 1 << i;
+  }
+  production.lastUs = Wire.read_us();
+  return 0;
+}
+
+//*************************************
+/**
+ * 量産モードの終了
+ *
+ * 量産モード用に読み込んだimageを破棄する(次の書き込みからHEX file,.gpbを使う)
+ */
+//*************************************
+void productionEnd(void) {
+  for (int i = 0; i < 2; i++) {
+    if (productionLoaded & (1 << i)) {
+      memset(&ramImage[i], 0x00, sizeof(ramImage[i]));
+    }
+  }
+  productionLoaded = 0;
+}
+
+/**
+ * 量産モードの経過時間の積算(GreenPakの抜き差しを待つ間も呼び出す)
+ */
+void productionTick(void) {
+  uint32_t now = Wire.read_us();
+  production.elapsedUs += (uint32_t)(now - production.lastUs);
+  production.lastUs = now;
+}
+
+//*************************************
+/**
+ * 量産モードでの1個の書き込み
+ *
+ * 書き込み後の確認(verifyChip())は設定にかかわらず必ず行う
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @return 0:正常終了 -1:異常終了
+ */
+//*************************************
+int productionPart(greenPakDevice_t *dev) {
+  uint32_t start = Wire.read_us();
+  traceBegin();
+  bool verify = autoVerify;
+
+  autoVerify = true;
+  int ans = writeChip(dev, NVM);
+  if ((ans == 0) && productionEeprom) {
+    ans = writeChip(dev, EEPROM);
+  }
+  autoVerify = verify;
+
+  uint32_t us = Wire.read_us() - start;
+  if ((production.parts == 0) || (us < production.cycleMinUs)) {
+    production.cycleMinUs = us;
+  }
+  if (us > production.cycleMaxUs) {
+    production.cycleMaxUs = us;
+  }
+  production.cycleTotalUs += us;
+  production.parts++;
+  if (ans == 0) {
+    production.passed++;
+  }
+  productionTick();
+
+  pc.log(CONSOLE_QUIET, "part %lu %s %lums\n", (unsigned long)production.parts,
+         (ans == 0) ? "OK" : "NG", (unsigned long)(us / 1000));
+  return (ans == 0) ? 0 : -1;
+}
+
+/**
+ * 量産モードの集計のクリア
+ */
+void productionClear(void) {
+  memset(&production, 0x00, sizeof(production));
+  production.lastUs = Wire.read_us();
+}
+
+//*************************************
+/**
+ * 量産モードの集計の表示
+ *
+ * 個数, 歩留まり, 1時間あたりの個数, 1個の処理時間(最小/平均/最大)
+ */
+//*************************************
+void productionPrint(void) {
+  uint32_t parts = production.parts;
+  uint32_t yield10 = (parts == 0) ? 0 : (production.passed * 1000ULL / parts);
+  uint32_t perHour =
+      (production.elapsedUs == 0)
+          ? 0
+          : (uint32_t)(parts * 3600000000ULL / production.elapsedUs);
+  uint32_t avgMs =
+      (parts == 0) ? 0 : (uint32_t)(production.cycleTotalUs / parts / 1000);
+
+  pc.log(CONSOLE_QUIET, "parts %lu, pass %lu, fail %lu, yield %lu.%lu%%\n",
+         (unsigned long)parts, (unsigned long)production.passed,
+         (unsigned long)(parts - production.passed),
+         (unsigned long)(yield10 / 10), (unsigned long)(yield10 % 10));
+  pc.log(CONSOLE_QUIET, "%lu parts/h, elapsed %lus\n", (unsigned long)perHour,
+         (unsigned long)(production.elapsedUs / 1000000));
+  pc.log(CONSOLE_QUIET, "cycle min/avg/max = %lu/%lu/%lums\n",
+         (unsigned long)(production.cycleMinUs / 1000), (unsigned long)avgMs,
+         (unsigned long)(production.cycleMaxUs / 1000));
+}
+
+//=====================================
+// バックグラウンド処理
+//=====================================
+job_t job = {}; //<! バックグラウンド処理
+
+static const char *jobName(jobType_t type) {
+  return (type == JOB_ERASE) ? "erase"
+                             : ((type == JOB_WRITE) ? "write" : "read");
+}
+
+/**
+ * 時刻になったか(read_us()の一巡を考慮)
+ */
+static bool jobReady(uint32_t now) {
+  return (int32_t)(now - job.readyUs) >= 0;
+}
+
+/**
+ * 次に処理するpageの検索
+ *
+ * @return 0～15:page -1:なし
+ */
+static int jobNextPage(uint16_t mask, int page) {
+  for (; page < 16; page++) {
+    if (mask & (1 << page)) {
+      return page;
+    }
+  }
+  return -1;
+}
+
+/**
+ * 終了
+ */
+static void jobEnd(int result) {
+  Wire.stop();
+  job.result = result;
+  job.state = JOB_IDLE;
+  pc.progress(jobName(job.type), job.done, job.total);
+  pc.log(CONSOLE_QUIET, "%s %s%s %lums\n", jobName(job.type),
+         (result == 0) ? "OK" : "NG", job.abort ? "(abort)" : "",
+         (unsigned long)((Wire.read_us() - job.startUs) / 1000));
+}
+
+/**
+ * 失敗したpageのやり直し
+ *
+ * pageRetry()と同じくpageBackoffUsから倍にした時間を待ってから、
+ * 同じpageの指示からやり直す. 待ちはjob.readyUsで行い処理を止めない
+ * @param[in] jobState_t issue: やり直す状態(JOB_ERASE_ISSUE,JOB_WRITE_ISSUE)
+ * @return true:やり直す false:retry回数を使い切った
+ */
+static bool jobRetry(uint32_t now, jobState_t issue) {
+  const char *phase = (issue == JOB_ERASE_ISSUE) ? "erase" : "write";
+
+  if (job.retry >= pageRetries) {
+    resume.failedPage = job.page;
+    pc.log(CONSOLE_QUIET, "page 0x%02x %s NG\n", job.page, phase);
+    return false;
+  }
+  resume.retries[job.page]++;
+  uint32_t us = pageBackoffUs << job.retry;
+  pc.log(CONSOLE_QUIET, "page 0x%02x %s retry %d (%luus)\n", job.page, phase,
+         job.retry + 1, (unsigned long)us);
+  Wire.stop();
+  job.retry++;
+  job.readyUs = now + us;
+  job.state = issue;
+  return true;
+}
+
+/**
+ * GreenPakの確認, 書き込みデータの準備, クリアするpageの確認
+ */
+template <class Device> static int jobOpen(void) {
+  greenPakDevice_t *dev = job.dev;
+  // NVMのslave address(0xCA)のhexData[][]での位置
+  uint8_t &slaveAddressByte = hexData[Device::regSlaveAddress / Device::pageSize]
+                                     [Device::regSlaveAddress % Device::pageSize];
+
+  if (!Device::hasEeprom && (job.memoryType == EEPROM)) {
+    pc.log(CONSOLE_QUIET, "%s has no EEPROM\n", Device::name());
+    return -1;
+  }
+  if (deviceOpen(dev) != 0) {
+    return -1;
+  }
+  if (job.type == JOB_READ) {
+    job.total = Device::pages;
+    return 0;
+  }
+  if (job.memoryType != RESISTER) {
+    resister_unprotect<Device>(dev);
+  }
+  if (job.type == JOB_WRITE) {
+    // RESISTERにはNVM用のデータを書き込む
+    if (imageRead((job.memoryType == EEPROM) ? EEPROM : NVM) != 256) {
+      return -1;
+    }
+    if (job.memoryType == NVM) {
+      uint8_t next = (imageSlaveAddress <= 0x0f) ? imageSlaveAddress
+                                                  : dev->slaveAddress;
+      slaveAddressByte = (slaveAddressByte & 0xF0) | next;
+    } else if (job.memoryType == RESISTER) {
+      slaveAddressByte = (slaveAddressByte & 0xF0) | dev->slaveAddress;
+    }
+    job.writeMask = (1 << Device::pages) - 1;
+  }
+  if (job.memoryType != RESISTER) {
+    if (readBlock<Device>(dev->slaveAddress, job.memoryType, chipData) != 0) {
+      return -1;
+    }
+    job.eraseMask = ~blankPages(chipData);
+  }
+  job.total = pageCount(job.eraseMask) + pageCount(job.writeMask);
+  return 0;
+}
+
+//*************************************
+/**
+ * バックグラウンド処理の開始
+ *
+ * 書き込みはwriteChip()と同じ内容で、powercycleは書き込み完了後の1回だけ行う
+ * (途中でpowercycleしないので、NVMのslave addressは最後まで変わらない)
+ * @param[in] jobType_t type: 処理
+ * @param[in,out] greenPakDevice_t* dev: 操作対象GreenPak
+ * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示
+ * @return 0:開始した -1:処理中
+ */
+//*************************************
+int jobStart(jobType_t type, greenPakDevice_t *dev,
+             greenPakMemory_t memoryType) {
+  if (jobBusy()) {
+    return -1;
+  }
+  memset(&job, 0x00, sizeof(job));
+  if (type != JOB_READ) {
+    resume.pending = false;
+    resume.failedPage = -1;
+    memset(resume.retries, 0x00, sizeof(resume.retries));
+  }
+  job.type = type;
+  job.memoryType = memoryType;
+  job.dev = dev;
+  job.state = JOB_OPEN;
+  job.startUs = Wire.read_us();
+  job.readyUs = job.startUs;
+  traceBegin();
+  return 0;
+}
+
+/**
+ * 選択中の型番でのバックグラウンド処理を1つ進める
+ *
+ * 待ち時間はwritePages(),writeChip()と同じ(page write送信後, ACK後, クリア後)
+ * @param[in] uint32_t now: 現在時刻
+ * @return true:処理中 false:終了した
+ */
+template <class Device> static bool jobRun(uint32_t now) {
+  // NVMのslave address(0xCA)のhexData[][]での位置
+  const uint8_t &slaveAddressByte =
+      hexData[Device::regSlaveAddress / Device::pageSize]
+             [Device::regSlaveAddress % Device::pageSize];
+  int control_code;
+
+  switch (job.state) {
+  case JOB_OPEN:
+    if (jobOpen<Device>() != 0) {
+      jobEnd(-1);
+      return false;
+    }
+    job.page = 0;
+    job.state = (job.type == JOB_READ) ? JOB_READ_LINE : JOB_ERASE_ISSUE;
+    break;
+
+  case JOB_ERASE_ISSUE:
+    job.page = jobNextPage(job.eraseMask, job.page);
+    if (job.page < 0) {
+      // クリア済み. 書き込みがあれば安定待ちしてから書き込む
+      job.page = 0;
+      job.state = (job.writeMask == 0) ? JOB_FINISH : JOB_SETTLE;
+      if ((job.eraseMask != 0) && (job.writeMask != 0)) {
+        job.readyUs = now + settleUs(SETTLE_ERASE);
+      }
+      job.pollUs = now;
+      break;
+    }
+    i2cBuffer[0] = Device::regPageErase;
+    i2cBuffer[1] = Device::pageErase(job.memoryType, job.page);
+    Wire.write((job.dev->slaveAddress << 4) | Device::resisterConfig, i2cBuffer,
+               2);
+    job.pollUs = now;
+    job.state = JOB_ERASE_POLL;
+    break;
+
+  case JOB_WRITE_ISSUE:
+    job.page = jobNextPage(job.writeMask, job.page);
+    if (job.page < 0) {
+      job.state = JOB_FINISH;
+      break;
+    }
+    i2cBuffer[0] = job.page * Device::pageSize;
+    memcpy(&i2cBuffer[1], hexData[job.page], Device::pageSize);
+    control_code =
+        (job.dev->slaveAddress << 4) | Device::blockConfig(job.memoryType);
+    if (Wire.write(control_code, i2cBuffer, Device::pageSize + 1) != 0) {
+      if (jobRetry(now, JOB_WRITE_ISSUE)) {
+        break;
+      }
+      jobEnd(-1);
+      return false;
+    }
+    // page write送信後の待ち(writePages()と同じ)が過ぎてからACKを確認する
+    job.pollUs = now;
+    job.readyUs = now + settleUs(SETTLE_GAP);
+    job.state = JOB_WRITE_POLL;
+    break;
+
+  case JOB_ERASE_POLL:
+  case JOB_WRITE_POLL:
+    // tER,tWRの終了待ち: ACKが返るまでackPollIntervalUsごとに確認する
+    if (Wire.read(job.dev->slaveAddress << 4, i2cBuffer, 0) != 0) {
+      if ((now - job.pollUs) >= ackPollTimeoutUs) {
+        if (jobRetry(now, (job.state == JOB_ERASE_POLL) ? JOB_ERASE_ISSUE
+                                                        : JOB_WRITE_ISSUE)) {
+          break;
+        }
+        jobEnd(-1);
+        return false;
+      }
+      job.readyUs = now + ackPollIntervalUs;
+      break;
+    }
+    traceEnd((job.state == JOB_ERASE_POLL) ? TRACE_ERASE : TRACE_WRITE,
+             job.pollUs, job.page);
+    pc.progress(jobName(job.type), ++job.done, job.total);
+    pc.log(CONSOLE_VERBOSE, "page 0x%02x %s %luus\n", job.page,
+           (job.state == JOB_ERASE_POLL) ? "erase" : "write",
+           (unsigned long)(now - job.pollUs));
+    // ACK後の待ち(erasePages(),writePages()と同じ)が過ぎてから次のpageに進む
+    job.readyUs = now + settleUs(SETTLE_READY);
+    job.state =
+        (job.state == JOB_ERASE_POLL) ? JOB_ERASE_ISSUE : JOB_WRITE_ISSUE;
+    job.page++;
+    job.retry = 0;
+    break;
+
+  case JOB_SETTLE:
+    if (job.eraseMask != 0) {
+      traceEnd(TRACE_SETTLE, job.pollUs);
+    }
+    job.state = JOB_WRITE_ISSUE;
+    break;
+
+  case JOB_READ_LINE:
+    // word addressは最初だけ設定し、以後はaddress自動加算で続きを読み出す
+    control_code =
+        (job.dev->slaveAddress << 4) | Device::blockConfig(job.memoryType);
+    i2cBuffer[0] = 0x00;
+    if (((job.page == 0) &&
+         (Wire.write(control_code, i2cBuffer, 1, true) != 0)) ||
+        (Wire.read(control_code, (char *)chipData[job.page], Device::pageSize,
+                   true) != 0)) {
+      jobEnd(-1);
+      return false;
+    }
+    job.done++;
+    if (++job.page >= Device::pages) {
+      job.state = JOB_FINISH;
+    }
+    break;
+
+  case JOB_FINISH:
+    if (job.type == JOB_READ) {
+      for (int i = 0; i < 16; i++) {
+        pc.log(CONSOLE_QUIET, "%02x :", i);
+        for (int j = 0; j < 16; j++) {
+          pc.log(CONSOLE_QUIET, "%02x ", chipData[i][j]);
+        }
+        pc.log(CONSOLE_QUIET, "\n");
+      }
+    } else if (job.memoryType == NVM) {
+      // NVMを書き換えたら再起動させて動作に反映させる
+      uint8_t slaveAddress = job.dev->slaveAddress;
+      if ((job.eraseMask | job.writeMask) != 0) {
+        powercycle<Device>(job.dev);
+      }
+      if ((job.type == JOB_ERASE) &&
+          (job.eraseMask &
+           (1 << (Device::regSlaveAddress / Device::pageSize)))) {
+        deviceInvalidate(job.dev);
+      } else if ((job.type == JOB_WRITE) &&
+                 ((slaveAddressByte & 0x0f) != slaveAddress)) {
+        deviceInvalidate(job.dev);
+      }
+    }
+    // hexData[][]は書き込んだ内容(slave address差し替え済み)のまま
+    if ((job.type == JOB_WRITE) && autoVerify &&
+        (verifyImage(job.dev, job.memoryType, hexData) != 0)) {
+      jobEnd(-1);
+      return false;
+    }
+    jobEnd(0);
+    return false;
+
+  default:
+    jobEnd(-1);
+    return false;
+  }
+  return true;
+}
+
+//*************************************
+/**
+ * バックグラウンド処理を1つ進める
+ *
+ * 待ち時間中は何もせずに戻る
+ * 中断指示があれば、GreenPakが処理中(tER,tWR)のpageの終了を待ってから終了する
+ * @return true:処理中 false:処理なし,終了した
+ */
+//*************************************
+bool jobStep(void) {
+  uint32_t now = Wire.read_us();
+
+  if (job.state == JOB_IDLE) {
+    return false;
+  }
+  if (!jobReady(now)) {
+    return true;
+  }
+  if (job.abort && (job.state != JOB_ERASE_POLL) &&
+      (job.state != JOB_WRITE_POLL)) {
+    jobEnd(-1);
+    return false;
+  }
+  DEVICE_DISPATCH(jobRun, (now));
+}
+
+/**
+ * バックグラウンド処理中か
+ */
+bool jobBusy(void) { return job.state != JOB_IDLE; }
+
+/**
+ * バックグラウンド処理の中断指示
+ */
+void jobAbort(void) {
+  if (jobBusy()) {
+    job.abort = true;
+  }
+}
+
+//*************************************
+/**
+ * バックグラウンド処理の進捗表示
+ */
+//*************************************
+void jobPrint(void) {
+  if (!jobBusy()) {
+    pc.log(CONSOLE_QUIET, "job: idle (last %s %s)\n", jobName(job.type),
+           (job.result == 0) ? "OK" : "NG");
+    return;
+  }
+  pc.log(CONSOLE_QUIET, "job: %s %d/%d page 0x%02x %lums\n", jobName(job.type),
+         job.done, job.total, job.page,
+         (unsigned long)((Wire.read_us() - job.startUs) / 1000));
+}
+
+//=====================================
+// 処理時間の記録
+//=====================================
+static traceEntry_t trace[Z_traceEntries] AHBSRAM0; //<! 処理時間(環状buffer)
+static uint32_t traceCount = 0;   //<! traceBegin()から記録した数
+static uint32_t traceBeginUs = 0; //<! traceBegin()の時刻
+static traceStats_t traceStats[Z_tracePhases] = {}; //<! 処理ごとの集計
+
+static const char *const traceNames[Z_tracePhases] = {
+    "hex", "unprotect", "read", "erase", "write", "ack", "settle", "powercycle"};
+
+static const uint32_t traceBinUs[Z_traceBins - 1] = {100, 1000, 10000,
+                                                     100000, 1000000};
+
+//*************************************
+/**
+ * 1回分の処理時間の記録の開始
+ *
+ * 記録した処理時間を破棄する(集計はtraceClear()まで残す)
+ * PCからの1行のcommand, 量産モードの1個, バックグラウンド処理の開始時に呼び出す
+ */
+//*************************************
+void traceBegin(void) {
+  traceCount = 0;
+  traceBeginUs = Wire.read_us();
+}
+
+/**
+ * 処理時間の計測開始
+ *
+ * @return 開始時刻(traceEnd()に渡す)
+ */
+uint32_t traceStart(void) { return Wire.read_us(); }
+
+//*************************************
+/**
+ * 処理時間の記録
+ *
+ * @param[in] tracePhase_t phase: 処理
+ * @param[in] uint32_t start: traceStart()の戻り値
+ * @param[in] int page: page(pageごとの処理以外は-1)
+ * @param[in] uint32_t polls: ACK確認の回数
+ */
+//*************************************
+void traceEnd(tracePhase_t phase, uint32_t start, int page, uint32_t polls) {
+  uint32_t us = Wire.read_us() - start;
+
+  traceEntry_t *entry = &trace[traceCount % Z_traceEntries];
+  entry->startUs = start - traceBeginUs;
+  entry->us = us;
+  entry->polls = (polls > 0xffff) ? 0xffff : polls;
+  entry->phase = phase;
+  entry->page = page;
+  traceCount++;
+
+  traceStats_t *stats = &traceStats[phase];
+  if ((stats->count == 0) || (us < stats->minUs)) {
+    stats->minUs = us;
+  }
+  if (us > stats->maxUs) {
+    stats->maxUs = us;
+  }
+  stats->totalUs += us;
+  stats->count++;
+  int bin = 0;
+  while ((bin < Z_traceBins - 1) && (us >= traceBinUs[bin])) {
+    bin++;
+  }
+  stats->bins[bin]++;
+}
+
+/**
+ * 処理時間の集計のクリア
+ */
+void traceClear(void) {
+  memset(traceStats, 0x00, sizeof(traceStats));
+  traceCount = 0;
+}
+
+//*************************************
+/**
+ * 処理時間の表示
+ *
+ * 最後のtraceBegin()から記録した処理(最新のZ_traceEntries個)と、
+ * 処理ごとの集計(回数, 最小/平均/最大, 処理時間の分布)を表示する
+ * @param[in] bool csv: true:CSV形式 false:表形式
+ */
+//*************************************
+void tracePrint(bool csv) {
+  uint32_t first =
+      (traceCount > Z_traceEntries) ? (traceCount - Z_traceEntries) : 0;
+
+  if (csv) {
+    pc.log(CONSOLE_QUIET, "no,phase,page,start_us,us,polls\n");
+  } else {
+    pc.log(CONSOLE_QUIET, "trace %lu entries (%lu dropped)\n",
+           (unsigned long)(traceCount - first), (unsigned long)first);
+    pc.log(CONSOLE_QUIET, " no phase      page  start[us]   time[us] polls\n");
+  }
+  for (uint32_t i = first; i < traceCount; i++) {
+    const traceEntry_t *entry = &trace[i % Z_traceEntries];
+    if (csv) {
+      pc.log(CONSOLE_QUIET, "%lu,%s,%d,%lu,%lu,%u\n", (unsigned long)i,
+             traceNames[entry->phase], entry->page,
+             (unsigned long)entry->startUs, (unsigned long)entry->us,
+             entry->polls);
+    } else {
+      pc.log(CONSOLE_QUIET, "%3lu %-10s %4d %10lu %10lu %5u\n",
+             (unsigned long)i, traceNames[entry->phase], entry->page,
+             (unsigned long)entry->startUs, (unsigned long)entry->us,
+             entry->polls);
+    }
+  }
+
+  if (csv) {
+    pc.log(CONSOLE_QUIET, "phase,count,min_us,avg_us,max_us,"
+                          "lt100us,lt1ms,lt10ms,lt100ms,lt1s,ge1s\n");
+  } else {
+    pc.log(CONSOLE_QUIET, "phase      count    min[us]    avg[us]    max[us]"
+                          "  <100u  <1m <10m <100m  <1s >=1s\n");
+  }
+  for (int i = 0; i < Z_tracePhases; i++) {
+    const traceStats_t *stats = &traceStats[i];
+    if (stats->count == 0) {
+      continue;
+    }
+    unsigned long avg = (unsigned long)(stats->totalUs / stats->count);
+    const uint32_t *b = stats->bins;
+    if (csv) {
+      pc.log(CONSOLE_QUIET, "%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+             traceNames[i], (unsigned long)stats->count,
+             (unsigned long)stats->minUs, avg, (unsigned long)stats->maxUs,
+             (unsigned long)b[0], (unsigned long)b[1], (unsigned long)b[2],
+             (unsigned long)b[3], (unsigned long)b[4], (unsigned long)b[5]);
+    } else {
+      pc.log(CONSOLE_QUIET,
+             "%-10s %5lu %10lu %10lu %10lu %6lu %4lu %4lu %5lu %4lu %4lu\n",
+             traceNames[i], (unsigned long)stats->count,
+             (unsigned long)stats->minUs, avg, (unsigned long)stats->maxUs,
+             (unsigned long)b[0], (unsigned long)b[1], (unsigned long)b[2],
+             (unsigned long)b[3], (unsigned long)b[4], (unsigned long)b[5]);
+    }
+  }
+}
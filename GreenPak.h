@@ -0,0 +1,555 @@
+/**
+ * GreenPak(SLG46826V) 書き込み処理
+ *
+ * NVM,EEPROM,RESISTERの読み書き,クリアとHEX fileの読み込みを行う。
+ * SLG46824,SLG46827も同じ処理で書き込める(型番ごとの定義はGreenPakDevice.h)
+ * I2C通信とPCへの表示はGreenPakBus.hの Wire, pc を使う
+ * (実体はmbedではmain.cpp, PC上ではhost/で用意する)
+ *
+ * @file
+ */
+#ifndef GREENPAK_H
+#define GREENPAK_H
+
+#include "GreenPakBus.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * mbed(LPC1768)ではRAMが足りないので、Ethernet用エリア(AHBSRAM0)を使う
+ * 書き込みデータのlibraryはUSB/Ethernet用のもう1つのエリア(AHBSRAM1)に置く
+ */
+#if defined(TARGET_LPC1768)
+#define AHBSRAM0 __attribute__((section("AHBSRAM0")))
+#define AHBSRAM1 __attribute__((section("AHBSRAM1")))
+#else
+#define AHBSRAM0
+#define AHBSRAM1
+#endif
+
+//=====================================
+// 接続先
+//=====================================
+extern GreenPakBus &Wire;   //<! GreenPakとのI2C通信路
+extern GreenPakConsole &pc; //<! PCへの表示出力先
+
+/**
+ * HEX fileを置いているディレクトリ
+ *
+ * mbedでは"/local/"(LocalFileSystem), PC上では任意のディレクトリを指定する
+ */
+extern const char *localDir;
+
+//=====================================
+// GreenPak のI2C処理
+//=====================================
+/**
+ * I2Cのslave address とGreenPakの"Control Byte"との関係
+ *
+ * I2Cのslave addressがGreenPakのControl byteに該当する
+ * Control byteの構成
+ * 上位4bit: Control Code :ICを特定するためのコード 0x0 ～ 0xf を選択できる
+ *  このプログラムで"slave address"と言っているのは実際にはこのControl
+ * Codeのことになる 下位4bit: Block Address :
+ * IC内部のNVM,EEPROM,RESISTERを指示する(最下位の1bitはI2C通信のR/Wbitになる)
+ * Block Address (Control Byte A10-8)
+ *      A10
+ *      |A9
+ *      ||A8
+ * xxxx 098xb
+ * xxxx 001xb :resster
+ * xxxx 010xb :NVM
+ * xxxx 110xb :EEPROM
+ * |  | |-| ←Block Address
+ * |  |
+ * |←→| ←Control Code
+ */
+
+/**
+ * Block Address
+ */
+#define RESISTER_CONFIG (0x02)
+#define NVM_CONFIG (0x04)
+#define EEPROM_CONFIG (0x06)
+
+#define MASK_CONTROLCODE                                                       \
+  (0xf0) //<! I2C slave address部の ControlCode(上位4bit)を残すためのマスク
+
+extern uint8_t hexData[16][16];  //<! hex fileから読みだしたデータの保管用
+extern uint8_t chipData[16][16]; //<! GreenPakから読みだしたデータの保管用
+extern uint8_t hexPresent[32];   //<! hexData[][]の読み込み済みbyte(1bit/byte)
+extern bool hexVerbose; //<! true:HEX file読み込み時にrecordの内容を表示
+
+/**
+ * HEX file解析エラー
+ */
+typedef enum {
+  HEX_OK = 0,
+  HEX_ERR_FORMAT = -1,    //<! ':'がない, hex以外の文字
+  HEX_ERR_LENGTH = -2,    //<! byte countと文字数の不一致
+  HEX_ERR_CHECKSUM = -3,  //<! checksum不一致
+  HEX_ERR_TYPE = -4,      //<! 未対応のrecord type
+  HEX_ERR_RANGE = -5,     //<! addressが0x0000～0x00ffの範囲外
+  HEX_ERR_OVERLAP = -6,   //<! 同じaddressへの2回目のdata
+  HEX_ERR_AFTER_EOF = -7, //<! end of file recordの後のrecord
+  HEX_ERR_NO_EOF = -8,    //<! end of file recordがない
+  HEX_ERR_FILE = -9,      //<! fileが開けない
+  HEX_ERR_SIZE = -10      //<! fileが大きすぎる
+} hexError_t;
+
+/**
+ * HEX file解析状態
+ */
+typedef struct {
+  uint32_t base;    //<! 拡張address(record type 02,04)
+  uint16_t line;    //<! 解析した行数
+  uint16_t records; //<! data record数
+  uint16_t bytes;   //<! 読み込んだbyte数
+  bool eof;         //<! end of file record受信済み
+} hexParser_t;
+
+#define Z_hexFileSize                                                          \
+  (16 * 44 + 11) //<! hexFormat()で作るHEX fileのbyte数(16 record + end of file)
+
+/**
+ * 解析済みHEX file
+ *
+ * file sizeとCRCが同じであれば、再解析せずにこの内容を使う
+ * 解析してからの時間はhexCacheTick()で差分を積算する(read_us()の一巡を超えても数えられる)
+ */
+typedef struct {
+  bool valid;          //<! true:解析済み
+  uint32_t size;       //<! file size[byte]
+  uint32_t crc;        //<! file内容のCRC32
+  uint64_t ageUs;      //<! 解析してからの経過時間[us]
+  uint32_t lastUs;     //<! 前回hexCacheTick()の時刻
+  uint32_t hits;       //<! 再解析せずに使った回数
+  uint16_t records;    //<! data record数
+  uint16_t bytes;      //<! 読み込んだbyte数
+  uint8_t data[16][16]; //<! hexData[][]
+  uint8_t present[32];  //<! hexPresent[]
+} hexCache_t;
+
+extern hexCache_t hexCache[2]; //<! 0:NVM.hex, 1:EEPROM.hex
+
+/**
+ * binary image file (.gpb)
+ *
+ * HEX fileを変換した256byteのimageにheaderを付けたもの(272byte)
+ * 1回のfread()で読み込めて、ascii->hexの変換が不要になる
+ *
+ * offset size
+ *  0     4    magic "GPB1"
+ *  4     1    version (GPB_VERSION)
+ *  5     1    書き込み対象領域 (greenPakMemory_t)
+ *  6     1    device ID (GPB_DEVICE_xxx)
+ *  7     1    NVM書き込み時のslave address (0x00～0x0f, 0xff:指定なし)
+ *  8     4    dataのCRC32 (little endian)
+ *  12    4    予約(0x00)
+ *  16    256  data (address 0x00～0xff)
+ */
+#define GPB_MAGIC "GPB1"
+#define GPB_VERSION (1)
+#define GPB_DEVICE_SLG46824 (0x24)
+#define GPB_DEVICE_SLG46826 (0x26)
+#define GPB_DEVICE_SLG46827 (0x27)
+
+typedef struct {
+  char magic[4];
+  uint8_t version;
+  uint8_t target;
+  uint8_t deviceId;
+  uint8_t slaveAddress;
+  uint8_t crc[4];
+  uint8_t reserved[4];
+} gpbHeader_t;
+
+typedef struct {
+  gpbHeader_t header;
+  uint8_t data[16][16];
+} gpbImage_t;
+
+extern uint8_t imageSlaveAddress; //<! .gpbで指定されたslave address
+extern uint8_t imageDeviceId;     //<! .gpbで指定された型番(0:指定なし)
+
+/**
+ * RAM上の書き込みデータ
+ *
+ * PCからbinary通信(GreenPakProtocol.h)で受け取ったimage
+ * validの間はHEX file,.gpbより優先して使う(hfで破棄する)
+ */
+typedef struct {
+  bool valid;           //<! true:256byte全て受け取った
+  uint16_t pages;       //<! 受け取ったpage(bit0=page0 ～ bit15=page15)
+  uint8_t slaveAddress; //<! NVM書き込み時のslave address(0xff:指定なし)
+  uint8_t deviceId;     //<! 型番(GPB_DEVICE_xxx, 0:指定なし)
+  uint8_t data[16][16]; //<! 書き込みデータ
+} ramImage_t;
+
+extern ramImage_t ramImage[2]; //<! 0:NVM,RESISTER用 1:EEPROM用
+
+typedef enum {
+  NVM,
+  EEPROM,
+  RESISTER
+} greenPakMemory_t; //<! 操作対象メモリの指示用
+
+/**
+ * 書き込みデータのlibrary
+ *
+ * 製品ごとのHEX file(.gpb)を解析済みの状態でslotに保存しておき、選択したslotを
+ * ramImage[]にcopyして書き込みに使う(製品の切り替えでfileの差し替え,解析をしない)
+ */
+#define Z_librarySlots (16) //<! slot数(slot番号 0x0～0xf)
+
+typedef struct {
+  bool valid;                  //<! true:読み込み済み
+  greenPakMemory_t memoryType; //<! 書き込み先(NVM,EEPROM)
+  char name[13];               //<! 読み込んだfile名(8.3形式)
+  uint32_t crc;                //<! file内容のCRC32
+  uint8_t slaveAddress;        //<! .gpbで指定されたslave address(0xff:指定なし)
+  uint8_t deviceId;            //<! .gpbで指定された型番(0:指定なし)
+  uint8_t data[16][16];        //<! 書き込みデータ
+} librarySlot_t;
+
+extern librarySlot_t library[Z_librarySlots]; //<! 書き込みデータのlibrary
+
+extern char i2cBuffer[17]; //<! I2C送受信用バッファ
+
+/**
+ * 読み出し(readBlock())の1回のI2C readのbyte数
+ *
+ * word addressは先頭で1回だけ設定し、GreenPakのaddress自動加算で続けて読み出す
+ * 256で全体を1回で読み出す。転送長に制限がある場合は16の倍数で小さくする
+ */
+#define Z_readChunk (256)
+
+/**
+ * ACK polling設定
+ *
+ * tER(page erase),tWR(page write)は最大20ms程度なので、短い間隔で確認して
+ * ACKが返った時点で次の処理に進む
+ */
+#define Z_ackPollTimeoutUs (500000) //<! ACK待ちの制限時間初期値[us]
+#define Z_ackPollIntervalUs (200)   //<! ACK確認間隔初期値[us]
+#define Z_ackPollTimeoutMinMs (50)    //<! ACK待ちの制限時間の下限[ms](tER,tWRより長く)
+#define Z_ackPollTimeoutMaxMs (10000) //<! ACK待ちの制限時間の上限[ms]
+#define Z_ackPollIntervalMinUs (10)     //<! ACK確認間隔の下限[us]
+#define Z_ackPollIntervalMaxUs (100000) //<! ACK確認間隔の上限[us]
+
+extern uint32_t ackPollTimeoutUs;  //<! ACK待ちの制限時間[us]
+extern uint32_t ackPollIntervalUs; //<! ACK確認間隔[us]
+
+typedef struct {
+  uint32_t polls;     //<! ACK確認回数
+  uint32_t elapsedUs; //<! ACKまでの時間[us]
+} ackPollResult_t;    //<! ACK確認結果
+
+extern ackPollResult_t ackPollLast; //<! 直前のACK確認結果
+
+/**
+ * pageごとのretry
+ *
+ * page erase,page writeがNACK,ACK確認の失敗になった場合は、待ち時間を倍にしながら
+ * 同じpageをpageRetries回までやり直す。それでも失敗した書き込みは、残りのpageを
+ * writeResume()で続けられるように記録しておく
+ * gangWrite()はGreenPakごとに、バックグラウンド処理は同じpageを同じ回数やり直す
+ */
+#define Z_pageRetries (3)       //<! retry回数初期値
+#define Z_pageRetriesMax (8)    //<! retry回数の上限
+#define Z_pageBackoffUs (2000)  //<! 1回目のretry前の待ち時間初期値[us]
+#define Z_pageBackoffMaxUs (100000) //<! 1回目のretry前の待ち時間の上限[us](倍にしてもあふれない)
+
+extern int pageRetries;        //<! retry回数
+extern uint32_t pageBackoffUs; //<! 1回目のretry前の待ち時間[us](retryごとに倍にする)
+
+typedef struct {
+  bool pending;                //<! true:途中で失敗した書き込みがある
+  greenPakMemory_t memoryType; //<! 書き込み先
+  uint8_t nextSlaveAddress;    //<! 書き込み完了後のslave address(NVM)
+  uint16_t eraseMask;          //<! まだクリアしていないpage
+  uint16_t writeMask;          //<! まだ書き込んでいないpage
+  int failedPage;              //<! 失敗したpage(-1:なし)
+  uint8_t retries[16];         //<! pageごとのretry回数(直前の書き込み)
+  uint8_t data[16][16];        //<! 書き込みデータ(slave address差し替え済み)
+} writeResume_t;
+
+extern writeResume_t resume; //<! 直前の書き込みのretry回数と続きの情報
+
+/**
+ * 処理後の待ち時間(settle profile)
+ *
+ * page erase,page writeの後などの待ち時間。初期値は以前の固定値で、
+ * settleCalibrate()で接続したGreenPakが確実に書き込める最短の値を測り、
+ * その1段階上(2倍)の値を/local/SETTLE.txtに保存する。測定した値には
+ * さらにmarginPct[%]を加えて使う
+ */
+#define Z_settleFile "SETTLE.txt" //<! 保存先(localDir)
+#define Z_settlePingUs (10000)    //<! ping()のaddressごとの間隔初期値[us]
+#define Z_settleGapUs (10000)     //<! page write送信後の待ち初期値[us]
+#define Z_settleReadyUs (100000)  //<! ACK後の待ち初期値[us]
+#define Z_settleEraseUs (300000)  //<! クリア後の安定待ち初期値[us]
+#define Z_settleMarginPct (50)    //<! 測定値に加える余裕初期値[%]
+#define Z_settleMinUs (1000) //<! 調整で試す最短の待ち時間[us](これより短くする場合は0)
+#define Z_settleRuns (3) //<! 調整で1つの待ち時間を確認する回数
+
+typedef enum {
+  SETTLE_PING,  //<! ping()のaddressごとの間隔
+  SETTLE_GAP,   //<! page write送信からACK確認までの待ち
+  SETTLE_READY, //<! page erase,page writeのACK後の待ち
+  SETTLE_ERASE, //<! クリア後,書き込み前の安定待ち
+  SETTLE_KINDS
+} settleKind_t;
+
+typedef struct {
+  bool calibrated;           //<! true:settleCalibrate()で測定した値
+  uint32_t marginPct;        //<! 測定値に加える余裕[%]
+  uint32_t us[SETTLE_KINDS]; //<! 待ち時間[us]
+} settleProfile_t;
+
+extern settleProfile_t settle; //<! 処理後の待ち時間
+
+/**
+ * 書き込み内容の確認結果
+ */
+#define Z_verifyList (16) //<! 不一致addressを記録する数
+
+typedef struct {
+  int mismatches;              //<! 不一致byte数
+  uint8_t offset[Z_verifyList]; //<! 不一致address(先頭からZ_verifyList個)
+  uint32_t crc;                //<! 読み出した内容のCRC32
+  uint32_t imageCrc;           //<! 書き込みデータのCRC32
+} verifyResult_t;
+
+extern bool autoVerify;            //<! true:書き込み後に内容を確認する
+extern verifyResult_t verifyLast; //<! 直前の書き込み内容確認結果
+
+/**
+ * 操作対象GreenPak
+ *
+ * 1回確認したslave address(Control Code)とprotect解除状態を覚えておき、
+ * command毎,処理毎のslave address検索を省略する
+ */
+typedef struct {
+  bool valid;           //<! true:slaveAddressは確認済み
+  bool unprotected;     //<! true:protect解除済み(0xE1=0x00, deviceOpen()で消す)
+  uint8_t slaveAddress; //<! slave address(Control Code) 0x00～0x0f
+} greenPakDevice_t;
+
+extern greenPakDevice_t session; //<! 操作対象GreenPak
+
+/**
+ * 操作対象GreenPakの型番(GPB_DEVICE_xxx)
+ *
+ * nxxのcommand, または型番を指定した.gpbの読み込み(imageRead())で切り替える
+ */
+extern uint8_t deviceType;
+
+/**
+ * I2C clock
+ *
+ * 速い順にGreenPakからの読み出しを試し、Z_busHzSafeで読み出した内容と
+ * 一致した最速のclockを使う
+ */
+#define Z_busHzSafe (10000) //<! 確実に通信できるI2C clock[Hz]
+#define Z_busSpeeds (3)     //<! 試すI2C clockの数
+
+extern const int busSpeedList[Z_busSpeeds]; //<! 試すI2C clock[Hz](速い順)
+extern int busHz;               //<! 使用中のI2C clock[Hz] 0:未決定
+extern int busPinnedHz;         //<! 固定したI2C clock[Hz] 0:自動選択
+extern uint32_t busBytesPerSec; //<! 直前に測定した読み出し速度[byte/s]
+
+/**
+ * 量産モードの集計
+ *
+ * 経過時間はproductionTick()で差分を積算する(read_us()の一巡を超えても数えられる)
+ */
+typedef struct {
+  uint32_t parts;        //<! 書き込んだ数
+  uint32_t passed;       //<! 書き込み,確認が正常終了した数
+  uint32_t cycleMinUs;   //<! 1個の処理時間の最小[us]
+  uint32_t cycleMaxUs;   //<! 1個の処理時間の最大[us]
+  uint64_t cycleTotalUs; //<! 1個の処理時間の合計[us]
+  uint64_t elapsedUs;    //<! 量産モードの経過時間[us]
+  uint32_t lastUs;       //<! 前回productionTick()の時刻
+} productionStats_t;
+
+extern productionStats_t production; //<! 量産モードの集計
+
+/**
+ * バックグラウンド処理(クリア,書き込み,読み出し)
+ *
+ * jobStart()で開始し、main()のloopからjobStep()を繰り返し呼び出す。
+ * jobStep()は1回に1つのI2C処理だけを行い、待ち時間(tER,tWR,settleUs()の
+ * page write送信後,ACK後,クリア後の待ち)はwriteChip()と同じ長さを
+ * wait()せずに時刻で管理するので、その間もcommand入力,表示ができる
+ */
+typedef enum {
+  JOB_ERASE, //<! クリア
+  JOB_WRITE, //<! クリア + 書き込み
+  JOB_READ   //<! 読み出し
+} jobType_t;
+
+typedef enum {
+  JOB_IDLE,    //<! 処理なし
+  JOB_OPEN,    //<! GreenPakの確認,データ準備
+  JOB_ERASE_ISSUE,
+  JOB_ERASE_POLL,
+  JOB_SETTLE,  //<! クリア後の安定待ち
+  JOB_WRITE_ISSUE,
+  JOB_WRITE_POLL,
+  JOB_READ_LINE,
+  JOB_FINISH   //<! powercycle,確認
+} jobState_t;
+
+typedef struct {
+  jobType_t type;
+  greenPakMemory_t memoryType;
+  greenPakDevice_t *dev;
+  jobState_t state;
+  int page;           //<! 処理中のpage(line)
+  int retry;          //<! 処理中のpageをやり直した回数
+  uint16_t eraseMask; //<! クリアするpage
+  uint16_t writeMask; //<! 書き込むpage
+  int done;           //<! 処理済みpage数
+  int total;          //<! 処理するpage数
+  uint32_t startUs;   //<! 開始時刻
+  uint32_t readyUs;   //<! 次の処理を行う時刻
+  uint32_t pollUs;    //<! ACK確認,安定待ちの開始時刻
+  bool abort;         //<! true:中断指示あり
+  int result;         //<! 0:正常終了 -1:異常終了,中断
+} job_t;
+
+extern job_t job; //<! バックグラウンド処理
+
+//=====================================
+// 処理時間の記録
+//=====================================
+#define Z_traceEntries (64) //<! 記録する処理の数(古いものから上書きする)
+#define Z_traceBins (6) //<! 処理時間の分布の区分(100us,1ms,10ms,100ms,1s,それ以上)
+
+/**
+ * 処理時間を記録する処理
+ */
+typedef enum {
+  TRACE_HEX,        //<! 書き込みデータの読み込み(imageRead())
+  TRACE_UNPROTECT,  //<! protect解除(resister_unprotect())
+  TRACE_READ,       //<! 256byteの読み出し(readBlock())
+  TRACE_ERASE,      //<! 1pageのクリア(ACK確認,安定待ちを含む)
+  TRACE_WRITE,      //<! 1pageの書き込み(ACK確認,安定待ちを含む)
+  TRACE_ACK,        //<! ACK確認(ackPolling())
+  TRACE_SETTLE,     //<! クリア後の安定待ち
+  TRACE_POWERCYCLE, //<! 再起動(powercycle())
+  Z_tracePhases
+} tracePhase_t;
+
+typedef struct {
+  uint32_t startUs; //<! 開始時刻(traceBegin()からの経過時間)
+  uint32_t us;      //<! 処理時間
+  uint16_t polls;   //<! ACK確認の回数(TRACE_ACKのみ)
+  uint8_t phase;    //<! tracePhase_t
+  int8_t page;      //<! page(pageごとの処理以外は-1)
+} traceEntry_t;
+
+/**
+ * 処理ごとの処理時間の集計(traceClear()するまで積算する)
+ */
+typedef struct {
+  uint32_t count;             //<! 回数
+  uint32_t minUs;             //<! 最小
+  uint32_t maxUs;             //<! 最大
+  uint64_t totalUs;           //<! 合計(平均の計算用)
+  uint32_t bins[Z_traceBins]; //<! 処理時間の分布
+} traceStats_t;
+
+//=====================================
+// 関数
+//=====================================
+FILE *localOpen(const char *name, const char *mode);
+uint32_t crc32(const uint8_t *data, int length, uint32_t crc = 0);
+uint8_t atoh1(char *p);
+uint8_t atoh2(char *p);
+int hexDecode(const char *p, uint8_t *data, int length);
+int hexFormat(const uint8_t data[16][16], char *text);
+void hexParseBegin(hexParser_t *hp);
+int hexParseLine(hexParser_t *hp, const char *line, bool verbose);
+int hexParseEnd(hexParser_t *hp);
+const char *hexErrorText(int error);
+int hexFileRead(greenPakMemory_t memoryType);
+const char *hexCacheName(const hexCache_t *cache);
+void hexCacheTick(void);
+void hexCachePrint(void);
+void hexCacheFlush(void);
+void gpbEncode(gpbImage_t *image, greenPakMemory_t target,
+               uint8_t slaveAddress);
+int gpbDecode(const gpbImage_t *image, greenPakMemory_t target);
+int imageRead(greenPakMemory_t memoryType);
+void ramImageClear(void);
+
+int deviceSelect(uint8_t deviceId);
+const char *deviceName(uint8_t deviceId);
+bool deviceSupports(greenPakMemory_t memoryType);
+void devicePrint(void);
+void ping(void);
+int checkSlaveAddres(void);
+int deviceOpen(greenPakDevice_t *dev);
+void deviceInvalidate(greenPakDevice_t *dev);
+int busNegotiate(int slaveAddress);
+int busFallback(void);
+int busPin(int hz);
+int busSpeedReport(greenPakDevice_t *dev);
+void powercycle(greenPakDevice_t *dev);
+int ackPolling(int addressForAckPolling);
+void printAckPolling(void);
+void printMemoryType(greenPakMemory_t memoryType);
+int blockConfig(greenPakMemory_t memoryType);
+void resister_unprotect(greenPakDevice_t *dev);
+int erasePages(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+               uint16_t pageMask);
+int eraseChip(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+uint16_t blankPages(uint8_t data[16][16]);
+int blankCheck(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+int writePages(int control_code, int addressForAckPolling, uint16_t pageMask);
+uint16_t diffPages(uint8_t now[16][16], uint8_t next[16][16]);
+int writeChip(greenPakDevice_t *dev, greenPakMemory_t memoryType,
+              int nextSlaveAddress = 0xff, bool diff = false);
+int writeResume(greenPakDevice_t *dev);
+void writeResumePrint(void);
+uint32_t settleUs(settleKind_t kind);
+void settleDefault(void);
+int settleLoad(void);
+int settleSave(void);
+int settleCalibrate(greenPakDevice_t *dev, greenPakMemory_t memoryType = EEPROM,
+                    bool nvmConfirmed = false);
+void settlePrint(void);
+int readBlock(int slaveAddress, greenPakMemory_t memoryType,
+              uint8_t data[16][16]);
+int readChip(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+int dumpChip(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+int verifyChip(greenPakDevice_t *dev, greenPakMemory_t memoryType);
+int libraryLoad(int slot, greenPakMemory_t memoryType, const char *name);
+int librarySelect(int slot);
+int libraryProgram(greenPakDevice_t *dev, int slot);
+void libraryPrint(void);
+int gangWrite(greenPakMemory_t memoryType, int excludeAddress = -1);
+int cloneChip(greenPakMemory_t memoryType, int goldenAddress = 0xff);
+int productionBegin(bool eeprom);
+void productionEnd(void);
+void productionTick(void);
+int productionPart(greenPakDevice_t *dev);
+void productionClear(void);
+void productionPrint(void);
+int jobStart(jobType_t type, greenPakDevice_t *dev,
+             greenPakMemory_t memoryType);
+bool jobStep(void);
+bool jobBusy(void);
+void jobAbort(void);
+void jobPrint(void);
+void traceBegin(void);
+uint32_t traceStart(void);
+void traceEnd(tracePhase_t phase, uint32_t start, int page = -1,
+              uint32_t polls = 0);
+void traceClear(void);
+void tracePrint(bool csv);
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ * GreenPak書き込み処理とハードウェアの間の接続定義
+ *
+ * GreenPak.cppの書き込み処理はmbedのI2C,Serialを直接使わずに、
+ * ここで定義するGreenPakBus(I2C + 時間),GreenPakConsole(PCへの表示),
+ * GreenPakLink(PCとのbinary通信)を使う。
+ * mbed上ではmain.cppがI2C,BufferedSerialを接続し、
+ * PC(Linux)上ではhost/のsimulatorを接続して動作確認,速度測定を行う。
+ *
+ * @file
+ */
+#ifndef GREENPAKBUS_H
+#define GREENPAKBUS_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//=====================================
+// I2C通信
+//=====================================
+/**
+ * GreenPakとのI2C通信路
+ *
+ * read(),write(),stop(),frequency()はmbedのI2Cクラスと同じ使い方にしている
+ * (addressは8bit表記, 戻り値 0:ACK 0以外:NACK)
+ * wait(),wait_us(),read_us()はI2C通信の時間軸で、
+ * simulatorではGreenPakのbusy時間(tER,tWR)もこの時間で管理する
+ */
+class GreenPakBus {
+public:
+  virtual ~GreenPakBus() {}
+
+  virtual void frequency(int hz) = 0;
+  virtual int read(int address, char *data, int length,
+                   bool repeated = false) = 0;
+  virtual int write(int address, const char *data, int length,
+                    bool repeated = false) = 0;
+  virtual void stop(void) = 0;
+
+  virtual void wait_us(uint32_t us) = 0;
+  virtual uint32_t read_us(void) = 0; //<! 起動からの経過時間[us]
+
+  void wait(float s) { wait_us((uint32_t)(s * 1000000.0f)); }
+};
+
+//=====================================
+// PCへの表示
+//=====================================
+/**
+ * 表示の詳しさ
+ */
+typedef enum {
+  CONSOLE_OFF = -1, //<! 何も表示しない(binary通信中)
+  CONSOLE_QUIET,    //<! 進捗1行と結果,異常だけを表示
+  CONSOLE_NORMAL,   //<! 処理の経過を表示
+  CONSOLE_VERBOSE   //<! page毎の内容,ACK確認結果も表示
+} consoleLevel_t;
+
+/**
+ * PCへの表示出力先
+ *
+ * 派生クラスはwrite()だけを用意すればよい
+ * printf()はCONSOLE_NORMAL以上, log()は指定した詳しさ以上の時に表示する
+ */
+class GreenPakConsole {
+public:
+  GreenPakConsole() : level(CONSOLE_NORMAL) {}
+  virtual ~GreenPakConsole() {}
+
+  virtual void write(const char *data, int length) = 0;
+
+  int printf(const char *format, ...) {
+    va_list arg;
+    va_start(arg, format);
+    int length = vlog(CONSOLE_NORMAL, format, arg);
+    va_end(arg);
+    return length;
+  }
+
+  int log(consoleLevel_t messageLevel, const char *format, ...) {
+    va_list arg;
+    va_start(arg, format);
+    int length = vlog(messageLevel, format, arg);
+    va_end(arg);
+    return length;
+  }
+
+  /**
+   * 進捗表示(CONSOLE_QUIETの時だけ, 1行を書き換えて表示する)
+   */
+  void progress(const char *name, int done, int total) {
+    if (level == CONSOLE_QUIET) {
+      log(CONSOLE_QUIET, "\r%s %d/%d%s", name, done, total,
+          (done >= total) ? "\n" : "");
+    }
+  }
+
+  consoleLevel_t level; //<! 表示の詳しさ
+
+private:
+  enum { Z_consoleLine = 128 }; //<! printf 1回分の最大文字数
+
+  int vlog(consoleLevel_t messageLevel, const char *format, va_list arg) {
+    if (messageLevel > level) {
+      return 0;
+    }
+    char text[Z_consoleLine];
+    int length = vsnprintf(text, sizeof(text), format, arg);
+    if (length >= (int)sizeof(text)) {
+      length = sizeof(text) - 1;
+    }
+    if (length > 0) {
+      write(text, length);
+    }
+    return length;
+  }
+};
+
+//=====================================
+// PCとのbinary通信
+//=====================================
+/**
+ * PCとのbyte単位の通信路(GreenPakProtocol.hのframeを送受信する)
+ *
+ * mbed上ではUSB-Serial, PC上では実機のserial portまたは試験用のloopbackを接続する
+ */
+class GreenPakLink {
+public:
+  virtual ~GreenPakLink() {}
+
+  virtual int readable(void) = 0; //<! 1:受信データあり
+  virtual int getc(void) = 0;
+  virtual void write(const char *data, int length) = 0;
+};
+
+#endif
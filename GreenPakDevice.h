@@ -0,0 +1,94 @@
+/**
+ * GreenPakの型番ごとの定義 (compile時の定数)
+ *
+ * GreenPak.cppのクリア,書き込み,読み出し処理は、ここで定義するtraitsを
+ * template引数にして型番ごとに作る。型番の違いはcompile時に解決し、
+ * 実行時の型番の分岐はcommandの入口(GreenPak.cppのDEVICE_DISPATCH)で1回だけ行う
+ *
+ * 型番の追加: GreenPakTraits<>を特殊化し、DEVICE_DISPATCHとdeviceSelect()に加える
+ *
+ * @file
+ */
+#ifndef GREENPAKDEVICE_H
+#define GREENPAKDEVICE_H
+
+#include "GreenPak.h"
+
+/**
+ * SLG4682x共通の定義 (SLG46824/6 Hardware manual)
+ *
+ * Block Address, memoryの構成(16byte x 16page), レジスタアドレスは
+ * SLG46824,SLG46826,SLG46827で共通
+ */
+struct Slg4682x {
+  // Control ByteのBlock Address部
+  static constexpr uint8_t resisterConfig = RESISTER_CONFIG;
+  static constexpr uint8_t nvmConfig = NVM_CONFIG;
+  static constexpr uint8_t eepromConfig = EEPROM_CONFIG;
+
+  // memoryの構成
+  static constexpr int pages = 16;    //<! page数
+  static constexpr int pageSize = 16; //<! 1pageのbyte数(1回のI2C writeの単位)
+
+  // レジスタアドレス
+  static constexpr uint8_t regReset = 0xC8;        //<! bit1=1: software reset
+  static constexpr uint8_t resetBit = 0x02;        //<! regResetに書き込む値
+  static constexpr uint8_t regSlaveAddress = 0xCA; //<! bit3-0: slave address
+  static constexpr uint8_t regProtect = 0xE1;      //<! bit1-0: NVM protect
+  static constexpr uint8_t protectMask = 0x03;     //<! 0x00:protectなし
+  static constexpr uint8_t regPageErase = 0xE3;    //<! page erase
+
+  // Page Erase Register
+  // bit7: ERSE  1
+  // bit4: ERSEB4  0: NVM, 1:EEPROM
+  // bit3-0: ERSEB3-0: page address
+  static constexpr uint8_t eraseNvm = 0x80;
+  static constexpr uint8_t eraseEeprom = 0x90;
+
+  /**
+   * 操作対象memoryのBlock Address
+   */
+  static constexpr uint8_t blockConfig(greenPakMemory_t memoryType) {
+    return (memoryType == NVM)
+               ? nvmConfig
+               : ((memoryType == EEPROM) ? eepromConfig : resisterConfig);
+  }
+
+  /**
+   * Page Erase Registerに書き込む値
+   */
+  static constexpr uint8_t pageErase(greenPakMemory_t memoryType, int page) {
+    return ((memoryType == EEPROM) ? eraseEeprom : eraseNvm) | page;
+  }
+};
+
+/**
+ * 型番ごとの定義
+ *
+ * 未対応の型番(特殊化していないdeviceId)を使うとcompile errorになる
+ */
+template <uint8_t DeviceId> struct GreenPakTraits;
+
+template <> struct GreenPakTraits<GPB_DEVICE_SLG46824> : Slg4682x {
+  static constexpr uint8_t deviceId = GPB_DEVICE_SLG46824;
+  static constexpr bool hasEeprom = false; //<! EEPROMなし(NVMのみ)
+  static const char *name(void) { return "SLG46824"; }
+};
+
+template <> struct GreenPakTraits<GPB_DEVICE_SLG46826> : Slg4682x {
+  static constexpr uint8_t deviceId = GPB_DEVICE_SLG46826;
+  static constexpr bool hasEeprom = true; //<! 2k bit EEPROM
+  static const char *name(void) { return "SLG46826"; }
+};
+
+template <> struct GreenPakTraits<GPB_DEVICE_SLG46827> : Slg4682x {
+  static constexpr uint8_t deviceId = GPB_DEVICE_SLG46827;
+  static constexpr bool hasEeprom = true; //<! 2k bit EEPROM
+  static const char *name(void) { return "SLG46827"; }
+};
+
+typedef GreenPakTraits<GPB_DEVICE_SLG46824> Slg46824;
+typedef GreenPakTraits<GPB_DEVICE_SLG46826> Slg46826;
+typedef GreenPakTraits<GPB_DEVICE_SLG46827> Slg46827;
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * PCとのbinary通信 (framed, CRC付き)
+ *
+ * frameの作成,解析はmbedとPC(host/gpclient)で共通に使う
+ * protoPoll()はmbed側の受信,処理,応答を行う
+ *
+ * @file
+ */
+#include "GreenPakProtocol.h"
+#include <string.h>
+
+//=====================================
+// frame
+//=====================================
+static void protoPut16(uint8_t *p, uint16_t data) {
+  p[0] = data & 0xff;
+  p[1] = data >> 8;
+}
+
+static void protoPut32(uint8_t *p, uint32_t data) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (data >> (i * 8)) & 0xff;
+  }
+}
+
+static uint32_t protoGet32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+//*************************************
+/**
+ * frameの作成
+ *
+ * @param[out] uint8_t* frame: 作成先(Z_protoFrame byte以上)
+ * @param[in] uint8_t seq: sequence番号
+ * @param[in] uint8_t command: command (応答はcommand | PROTO_RESPONSE)
+ * @param[in] const uint8_t* payload: payload
+ * @param[in] int length: payload長(0～Z_protoPayload)
+ * @return frameのbyte数
+ */
+//*************************************
+int protoEncode(uint8_t *frame, uint8_t seq, uint8_t command,
+                const uint8_t *payload, int length) {
+  frame[0] = PROTO_SYNC0;
+  frame[1] = PROTO_SYNC1;
+  frame[2] = seq;
+  frame[3] = command;
+  protoPut16(&frame[4], length);
+  if (length > 0) {
+    memcpy(&frame[Z_protoHeader], payload, length);
+  }
+  protoPut32(&frame[Z_protoHeader + length], crc32(&frame[2], 4 + length));
+  return Z_protoHeader + length + 4;
+}
+
+/**
+ * frame受信の開始
+ */
+void protoParseBegin(protoParser_t *pp) {
+  pp->length = 0;
+  pp->lastUs = 0;
+}
+
+//*************************************
+/**
+ * frameの1byte受信
+ *
+ * syncが揃うまでの受信データは読み捨てる
+ * 受信完了後もframe[]の内容は次のbyteを受信するまで残る
+ * @param[in,out] protoParser_t* pp: 受信状態
+ * @param[in] uint8_t data: 受信データ
+ * @return 0:受信中 1:受信完了 負:受信異常(PROTO_ERR_CRC,PROTO_ERR_LENGTH)
+ */
+//*************************************
+int protoParse(protoParser_t *pp, uint8_t data) {
+  if ((pp->length == 0) && (data != PROTO_SYNC0)) {
+    return 0;
+  }
+  if ((pp->length == 1) && (data != PROTO_SYNC1)) {
+    pp->length = (data == PROTO_SYNC0) ? 1 : 0;
+    return 0;
+  }
+  pp->frame[pp->length++] = data;
+
+  if (pp->length < Z_protoHeader) {
+    return 0;
+  }
+  int length = protoLength(pp);
+  if (length > Z_protoPayload) {
+    pp->length = 0;
+    return PROTO_ERR_LENGTH;
+  }
+  if (pp->length < Z_protoHeader + length + 4) {
+    return 0;
+  }
+
+  pp->length = 0;
+  if (crc32(&pp->frame[2], 4 + length) !=
+      protoGet32(&pp->frame[Z_protoHeader + length])) {
+    return PROTO_ERR_CRC;
+  }
+  return 1;
+}
+
+uint8_t protoSeq(const protoParser_t *pp) { return pp->frame[2]; }
+
+uint8_t protoCommand(const protoParser_t *pp) { return pp->frame[3]; }
+
+int protoLength(const protoParser_t *pp) {
+  return pp->frame[4] | (pp->frame[5] << 8);
+}
+
+const uint8_t *protoPayload(const protoParser_t *pp) {
+  return &pp->frame[Z_protoHeader];
+}
+
+//=====================================
+// mbed側の処理
+//=====================================
+static protoParser_t protoRx AHBSRAM0;                 //<! 受信中のframe
+static uint8_t protoTx[Z_protoFrame] AHBSRAM0;         //<! 応答frame
+static uint8_t protoResult[Z_protoPayload] AHBSRAM0; //<! 応答payload
+static uint32_t protoFrameUs; //<! 最後に正常なframeを受け取った時刻[us]
+
+/**
+ * 書き込みデータの受け取り
+ *
+ * offset 0から受け取り直すと、それまでに受け取ったデータは破棄する
+ * @return 結果(protoStatus_t)
+ */
+static int protoUpload(const uint8_t *payload, int length) {
+  if ((length < 2) || (payload[0] > RESISTER)) {
+    return PROTO_ERR_COMMAND;
+  }
+  int offset = payload[1];
+  int count = length - 2;
+  if ((count == 0) || (count > Z_protoChunk) || (offset & 0x0f) ||
+      (count & 0x0f) || (offset + count > 256)) {
+    return PROTO_ERR_COMMAND;
+  }
+
+  ramImage_t *ram = &ramImage[(payload[0] == EEPROM) ? 1 : 0];
+  if (offset == 0) {
+    ram->valid = false;
+    ram->pages = 0;
+    ram->slaveAddress = 0xff;
+    ram->deviceId = 0;
+  }
+  memcpy(&ram->data[offset >> 4][0], &payload[2], count);
+  for (int i = 0; i < count; i += 16) {
+    ram->pages |= 1 << ((offset + i) >> 4);
+  }
+  ram->valid = (ram->pages == 0xffff);
+  return PROTO_OK;
+}
+
+/**
+ * 要求の処理
+ *
+ * @param[in] const protoParser_t* pp: 受信したframe
+ * @param[out] uint8_t* result: 応答payload
+ * @return 応答payload長
+ */
+static int protoExecute(const protoParser_t *pp, uint8_t *result) {
+  const uint8_t *payload = protoPayload(pp);
+  int length = protoLength(pp);
+  greenPakMemory_t target = NVM;
+  int ans;
+
+  if (length >= 1) {
+    if (payload[0] > RESISTER) {
+      result[0] = (uint8_t)PROTO_ERR_COMMAND;
+      return 1;
+    }
+    target = (greenPakMemory_t)payload[0];
+  }
+
+  switch (protoCommand(pp)) {
+  case PROTO_STATUS:
+    result[0] = PROTO_OK;
+    result[1] = session.valid;
+    result[2] = session.slaveAddress;
+    protoPut32(&result[3], busHz);
+    result[7] = (ramImage[0].valid ? 0x01 : 0x00) |
+                (ramImage[1].valid ? 0x02 : 0x00);
+    result[8] = autoVerify;
+    return 9;
+
+  case PROTO_UPLOAD:
+    result[0] = (uint8_t)protoUpload(payload, length);
+    return 1;
+
+  case PROTO_WRITE: {
+    if ((length != 3) || ((payload[1] > 0x0f) && (payload[1] != 0xff))) {
+      break;
+    }
+    // 転送途中のimageの代わりに/localのfileを書き込まないようにする
+    const ramImage_t *ram = &ramImage[(target == EEPROM) ? 1 : 0];
+    if ((ram->pages != 0) && !ram->valid) {
+      result[0] = (uint8_t)PROTO_ERR_UPLOAD;
+      return 1;
+    }
+    ans = writeChip(&session, target, payload[1], payload[2] != 0);
+    result[0] = (ans == 0) ? PROTO_OK : (uint8_t)PROTO_NG;
+    return 1;
+  }
+
+  case PROTO_VERIFY:
+    if (length != 1) {
+      break;
+    }
+    memset(&verifyLast, 0x00, sizeof(verifyLast));
+    ans = verifyChip(&session, target);
+    result[0] = (ans == 0) ? PROTO_OK : (uint8_t)PROTO_NG;
+    protoPut16(&result[1], verifyLast.mismatches);
+    protoPut32(&result[3], verifyLast.crc);
+    protoPut32(&result[7], verifyLast.imageCrc);
+    return 11;
+
+  case PROTO_READ:
+    if (length != 1) {
+      break;
+    }
+    if ((deviceOpen(&session) != 0) ||
+        (readBlock(session.slaveAddress, target, chipData) != 0)) {
+      result[0] = (uint8_t)PROTO_NG;
+      return 1;
+    }
+    result[0] = PROTO_OK;
+    memcpy(&result[1], chipData, 256);
+    return 257;
+
+  case PROTO_END:
+    result[0] = PROTO_OK;
+    return 1;
+
+  default:
+    break;
+  }
+  result[0] = (uint8_t)PROTO_ERR_COMMAND;
+  return 1;
+}
+
+/**
+ * binary通信の開始(protoPoll()を呼び出す前に1回呼び出す)
+ */
+void protoBegin(void) {
+  protoParseBegin(&protoRx);
+  protoFrameUs = Wire.read_us();
+}
+
+//*************************************
+/**
+ * PCからの要求の受信,処理,応答
+ *
+ * 受信済みのデータを全て処理してから戻る。binary通信中はmain()から繰り返し呼び出す
+ * 処理中の表示はframeと混ざらないように、呼び出し側でCONSOLE_OFFにしておく
+ * @param[in] GreenPakLink& link: PCとの通信路
+ * @return 0:継続 1:PROTO_ENDを受信した(binary通信の終了)
+ *         -1:Z_protoIdleUsの間正常なframeがない(binary通信の終了)
+ */
+//*************************************
+int protoPoll(GreenPakLink &link) {
+  int end = 0;
+
+  if ((Wire.read_us() - protoFrameUs) > Z_protoIdleUs) {
+    return -1;
+  }
+  if ((protoRx.length > 0) &&
+      ((Wire.read_us() - protoRx.lastUs) > Z_protoTimeoutUs)) {
+    protoRx.length = 0; // 途中で途切れたframeは破棄する
+  }
+
+  while ((end == 0) && link.readable()) {
+    int ans = protoParse(&protoRx, link.getc());
+    protoRx.lastUs = Wire.read_us();
+    if (ans == 0) {
+      continue;
+    }
+
+    uint8_t command = PROTO_NAK;
+    int length = 1;
+    if (ans == 1) {
+      command = protoCommand(&protoRx);
+      length = protoExecute(&protoRx, protoResult);
+      end = (command == PROTO_END) && (protoResult[0] == PROTO_OK);
+      protoFrameUs = Wire.read_us(); // 書き込みなどの処理時間は数えない
+    } else {
+      protoResult[0] = (uint8_t)ans;
+    }
+    int size = protoEncode(protoTx, protoSeq(&protoRx),
+                           command | PROTO_RESPONSE, protoResult, length);
+    link.write((const char *)protoTx, size);
+  }
+  return end;
+}
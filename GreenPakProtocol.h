@@ -0,0 +1,90 @@
+/**
+ * PCとのbinary通信 (framed, CRC付き)
+ *
+ * HEX fileをmbedのUSBドライブにcopyせずに、USB-Serialで書き込みデータを転送し、
+ * 書き込み,確認,読み出しを行う。PC側はhost/gpclientを使う
+ *
+ * <frame構成>
+ * offset size
+ *  0     2    sync 0xA5 0x5A
+ *  2     1    sequence番号 (応答は要求と同じ番号)
+ *  3     1    command (応答は command | PROTO_RESPONSE)
+ *  4     2    payload長 (little endian, 0～Z_protoPayload)
+ *  6     n    payload
+ *  6+n   4    CRC32 (offset 2～5+nの範囲, little endian)
+ *
+ * 応答のpayloadの先頭1byteは結果(protoStatus_t)
+ * PCは応答を待たずに次の要求を送ってよい。mbedは受け取った順に処理し、
+ * 要求ごとに応答を返す(受信異常の場合はPROTO_NAKを返す)
+ * 正常なframeをZ_protoIdleUsの間受け取らなければ、PROTO_ENDがなくても
+ * binary通信を終了する(PCが途中で止まった,外された場合)
+ *
+ * @file
+ */
+#ifndef GREENPAKPROTOCOL_H
+#define GREENPAKPROTOCOL_H
+
+#include "GreenPak.h"
+#include "GreenPakBus.h"
+#include <stdint.h>
+
+#define PROTO_SYNC0 (0xA5)
+#define PROTO_SYNC1 (0x5A)
+#define PROTO_RESPONSE (0x80) //<! 応答のcommandに付けるbit
+
+#define Z_protoHeader (6)    //<! sync + sequence + command + payload長
+#define Z_protoPayload (260) //<! payloadの最大byte数
+#define Z_protoFrame (Z_protoHeader + Z_protoPayload + 4) //<! frameの最大byte数
+#define Z_protoChunk (64) //<! PROTO_UPLOAD 1回の最大data数(16の倍数)
+#define Z_protoWindow (448) //<! 応答を待たずに送ってよいbyte数(mbedの受信バッファ以下)
+#define Z_protoTimeoutUs (100000) //<! frameの途中で受信が途切れた時に破棄するまでの時間[us]
+#define Z_protoIdleUs (10000000) //<! 正常なframeがない時にbinary通信を終了するまでの時間[us]
+
+/**
+ * command
+ *
+ * target: 0:NVM 1:EEPROM 2:RESISTER (greenPakMemory_t)
+ */
+typedef enum {
+  PROTO_STATUS = 0x01, //<! 状態 [] -> [result, valid, slaveAddress, busHz(4), ramImage, autoVerify]
+  PROTO_UPLOAD = 0x02, //<! 書き込みデータ転送 [target, offset, data...] -> [result]
+  PROTO_WRITE = 0x03,  //<! 書き込み [target, slaveAddress(0xff:継承), diff] -> [result] (転送途中はPROTO_ERR_UPLOAD)
+  PROTO_VERIFY = 0x04, //<! 確認 [target] -> [result, mismatches(2), crc(4), imageCrc(4)]
+  PROTO_READ = 0x05,   //<! 読み出し [target] -> [result, data(256)]
+  PROTO_END = 0x0F,    //<! binary通信の終了 [] -> [result]
+  PROTO_NAK = 0x7F     //<! 受信異常の通知(応答のみ) -> [result]
+} protoCommand_t;
+
+/**
+ * 応答の結果
+ */
+typedef enum {
+  PROTO_OK = 0,
+  PROTO_NG = -1,          //<! 処理の異常終了
+  PROTO_ERR_COMMAND = -2, //<! 未対応のcommand, payloadの内容が不正
+  PROTO_ERR_CRC = -3,     //<! CRC不一致
+  PROTO_ERR_LENGTH = -4,  //<! payload長が不正
+  PROTO_ERR_UPLOAD = -5   //<! 転送途中のimageがある(書き込まない)
+} protoStatus_t;
+
+/**
+ * frame受信状態
+ */
+typedef struct {
+  int length;                  //<! 受信済みbyte数
+  uint32_t lastUs;             //<! 最後に受信した時刻[us]
+  uint8_t frame[Z_protoFrame]; //<! 受信中のframe
+} protoParser_t;
+
+int protoEncode(uint8_t *frame, uint8_t seq, uint8_t command,
+                const uint8_t *payload, int length);
+void protoParseBegin(protoParser_t *pp);
+int protoParse(protoParser_t *pp, uint8_t data);
+uint8_t protoSeq(const protoParser_t *pp);
+uint8_t protoCommand(const protoParser_t *pp);
+int protoLength(const protoParser_t *pp);
+const uint8_t *protoPayload(const protoParser_t *pp);
+void protoBegin(void);
+int protoPoll(GreenPakLink &link);
+
+#endif
@@ -0,0 +1,193 @@
+/**
+ * mbedとのbinary通信 PC側 (GreenPakProtocol.h)
+ *
+ * @file
+ */
+#include "GpClient.h"
+#include <chrono>
+#include <string.h>
+
+GpClient::GpClient(GreenPakLink &link)
+    : timeoutMs(30000), sent(0), naks(0), _link(link), _seq(0),
+      _inFlight(0) {
+  protoParseBegin(&_parser);
+}
+
+//*************************************
+/**
+ * 要求の送信
+ *
+ * 応答待ちのbyte数がZ_protoWindowを超える場合は、古い要求の応答を待ってから送る
+ * (その応答はreceive()で受け取る)
+ * @return 0:正常終了 -1:応答待ちで制限時間を超えた
+ */
+//*************************************
+int GpClient::send(uint8_t command, const uint8_t *payload, int length) {
+  int size = protoEncode(_frame, _seq, command, payload, length);
+  while ((_inFlight + size > Z_protoWindow) && (_inFlight > 0)) {
+    response_t response;
+    if (receive(&response) != 0) {
+      return -1;
+    }
+    _done.push_back(response);
+  }
+  // receive()で_frame[]を使わないので、待った後でもそのまま送れる
+  _link.write((const char *)_frame, size);
+  pending_t pending = {_seq, size};
+  _pending.push_back(pending);
+  _inFlight += size;
+  _seq++;
+  sent++;
+  return 0;
+}
+
+//*************************************
+/**
+ * 応答の受信(送った順に1つ)
+ *
+ * @param[out] response_t* response: 応答
+ * @return 0:正常終了 -1:制限時間を超えた,送った順と違う応答
+ */
+//*************************************
+int GpClient::receive(response_t *response) {
+  if (!_done.empty()) {
+    *response = _done.front();
+    _done.pop_front();
+    return 0;
+  }
+  if (_pending.empty()) {
+    return -1;
+  }
+
+  std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (!_link.readable()) {
+      continue;
+    }
+    int ans = protoParse(&_parser, _link.getc());
+    if (ans == 0) {
+      continue;
+    }
+    if (ans < 0) {
+      return -1; // 応答の受信異常は再送できないので終了する
+    }
+
+    pending_t pending = _pending.front();
+    _pending.pop_front();
+    _inFlight -= pending.size;
+
+    response->seq = protoSeq(&_parser);
+    response->command = protoCommand(&_parser) & ~PROTO_RESPONSE;
+    response->length = protoLength(&_parser);
+    memcpy(response->payload, protoPayload(&_parser), response->length);
+    if (response->command == PROTO_NAK) {
+      naks++;
+    }
+    return (response->seq == pending.seq) ? 0 : -1;
+  }
+  return -1;
+}
+
+//*************************************
+/**
+ * 応答待ちの要求を全て受け取る
+ *
+ * @return 0:全てPROTO_OK 負:最初の異常(protoStatus_t), -1:応答なし
+ */
+//*************************************
+int GpClient::flush(void) {
+  int result = PROTO_OK;
+  response_t response;
+  while (!_pending.empty() || !_done.empty()) {
+    if (receive(&response) != 0) {
+      return PROTO_NG;
+    }
+    if ((result == PROTO_OK) && ((int8_t)response.payload[0] != PROTO_OK)) {
+      result = (int8_t)response.payload[0];
+    }
+  }
+  return result;
+}
+
+int GpClient::status(response_t *response) {
+  if ((flush() != PROTO_OK) || (send(PROTO_STATUS, NULL, 0) != 0) ||
+      (receive(response) != 0)) {
+    return PROTO_NG;
+  }
+  return (int8_t)response->payload[0];
+}
+
+//*************************************
+/**
+ * 書き込みデータの転送
+ *
+ * Z_protoChunk byteずつ応答を待たずに送る
+ * @return 結果(protoStatus_t)
+ */
+//*************************************
+int GpClient::upload(greenPakMemory_t target, const uint8_t data[16][16]) {
+  uint8_t payload[2 + Z_protoChunk];
+
+  if (flush() != PROTO_OK) {
+    return PROTO_NG;
+  }
+  for (int offset = 0; offset < 256; offset += Z_protoChunk) {
+    payload[0] = target;
+    payload[1] = offset;
+    memcpy(&payload[2], &data[offset >> 4][0], Z_protoChunk);
+    if (send(PROTO_UPLOAD, payload, sizeof(payload)) != 0) {
+      return PROTO_NG;
+    }
+  }
+  return flush();
+}
+
+int GpClient::write(greenPakMemory_t target, uint8_t slaveAddress,
+                    bool diff) {
+  uint8_t payload[3] = {(uint8_t)target, slaveAddress, (uint8_t)diff};
+  if ((flush() != PROTO_OK) ||
+      (send(PROTO_WRITE, payload, sizeof(payload)) != 0)) {
+    return PROTO_NG;
+  }
+  return flush();
+}
+
+int GpClient::verify(greenPakMemory_t target, int *mismatches) {
+  uint8_t payload[1] = {(uint8_t)target};
+  response_t response;
+  if ((flush() != PROTO_OK) ||
+      (send(PROTO_VERIFY, payload, sizeof(payload)) != 0) ||
+      (receive(&response) != 0)) {
+    return PROTO_NG;
+  }
+  if (response.length == 11) {
+    *mismatches = response.payload[1] | (response.payload[2] << 8);
+  }
+  return (int8_t)response.payload[0];
+}
+
+int GpClient::read(greenPakMemory_t target, uint8_t data[16][16]) {
+  uint8_t payload[1] = {(uint8_t)target};
+  response_t response;
+  if ((flush() != PROTO_OK) ||
+      (send(PROTO_READ, payload, sizeof(payload)) != 0) ||
+      (receive(&response) != 0)) {
+    return PROTO_NG;
+  }
+  if ((int8_t)response.payload[0] != PROTO_OK) {
+    return (int8_t)response.payload[0];
+  }
+  if (response.length != 257) {
+    return PROTO_ERR_LENGTH;
+  }
+  memcpy(data, &response.payload[1], 256);
+  return PROTO_OK;
+}
+
+int GpClient::end(void) {
+  if ((flush() != PROTO_OK) || (send(PROTO_END, NULL, 0) != 0)) {
+    return PROTO_NG;
+  }
+  return flush();
+}
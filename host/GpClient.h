@@ -0,0 +1,60 @@
+/**
+ * mbedとのbinary通信 PC側 (GreenPakProtocol.h)
+ *
+ * 要求はZ_protoWindow byteまで応答を待たずに送り、応答は送った順に受け取る
+ *
+ * @file
+ */
+#ifndef GPCLIENT_H
+#define GPCLIENT_H
+
+#include "GreenPakProtocol.h"
+#include <deque>
+#include <stdint.h>
+
+class GpClient {
+public:
+  explicit GpClient(GreenPakLink &link);
+
+  /**
+   * 応答
+   */
+  typedef struct {
+    uint8_t seq;                     //<! sequence番号
+    uint8_t command;                 //<! command (PROTO_RESPONSEなし)
+    int length;                      //<! payload長
+    uint8_t payload[Z_protoPayload]; //<! payload (先頭は結果)
+  } response_t;
+
+  int send(uint8_t command, const uint8_t *payload, int length);
+  int receive(response_t *response);
+  int flush(void);
+
+  int status(response_t *response);
+  int upload(greenPakMemory_t target, const uint8_t data[16][16]);
+  int write(greenPakMemory_t target, uint8_t slaveAddress = 0xff,
+            bool diff = false);
+  int verify(greenPakMemory_t target, int *mismatches);
+  int read(greenPakMemory_t target, uint8_t data[16][16]);
+  int end(void);
+
+  uint32_t timeoutMs; //<! 応答待ちの制限時間[ms]
+  uint32_t sent;      //<! 送信したframe数
+  uint32_t naks;      //<! PROTO_NAKを受け取った回数
+
+private:
+  typedef struct {
+    uint8_t seq;
+    int size; //<! frameのbyte数
+  } pending_t;
+
+  GreenPakLink &_link;
+  uint8_t _seq;
+  int _inFlight;                 //<! 応答待ちのbyte数
+  std::deque<pending_t> _pending; //<! 応答待ちの要求(送った順)
+  std::deque<response_t> _done;   //<! send()中に受け取った応答
+  protoParser_t _parser;
+  uint8_t _frame[Z_protoFrame];
+};
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * PC上でのGreenPakConsole (標準出力 または 出力なし)
+ *
+ * @file
+ */
+#ifndef HOSTCONSOLE_H
+#define HOSTCONSOLE_H
+
+#include "GreenPakBus.h"
+#include <stdio.h>
+
+class HostConsole : public GreenPakConsole {
+public:
+  HostConsole() : enable(false), bytes(0) {}
+
+  virtual void write(const char *data, int length) {
+    bytes += length;
+    if (enable) {
+      fwrite(data, 1, length, stdout);
+    }
+  }
+
+  bool enable;    //<! true:標準出力に表示する
+  uint32_t bytes; //<! 表示要求のあったbyte数
+};
+
+#endif
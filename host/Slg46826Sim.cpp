@@ -0,0 +1,213 @@
+/**
+ * SLG46826 I2C simulator
+ *
+ * @file
+ */
+#include "Slg46826Sim.h"
+#include <string.h>
+
+//=====================================
+// GreenPak 1個分
+//=====================================
+Slg46826Sim::Slg46826Sim(int controlCode)
+    : tErUs(20000), tWrUs(20000), noiseAfter(0), noiseWrites(0),
+      tSettleUs(0), erases(0), writes(0), resets(0), _pointer(0),
+      _busyUntilUs(0), _eraseEndUs(0) {
+  memset(nvm, 0x00, sizeof(nvm));
+  memset(eeprom, 0x00, sizeof(eeprom));
+  nvm[0xCA] = controlCode & 0x0f;
+  powerOn();
+}
+
+void Slg46826Sim::powerOn(void) {
+  memcpy(reg, nvm, sizeof(reg));
+  _pointer = 0;
+}
+
+uint8_t *Slg46826Sim::memory(int block) {
+  switch (block) {
+  case 0:
+  case 1:
+    return reg;
+  case 2:
+    return nvm;
+  case 3:
+    return eeprom;
+  default:
+    return NULL;
+  }
+}
+
+/**
+ * RESISTERへの1byte書き込み
+ */
+void Slg46826Sim::writeResister(uint64_t nowUs, uint8_t address,
+                                uint8_t data) {
+  switch (address) {
+  case 0xC8:
+    reg[address] = data;
+    if (data & 0x02) {
+      // soft reset: NVMの内容をRESISTERに再読込する
+      resets++;
+      powerOn();
+    }
+    break;
+  case 0xE3:
+    reg[address] = data;
+    if ((data & 0x80) && ((reg[0xE1] & 0x02) == 0)) {
+      uint8_t *p = (data & 0x10) ? eeprom : nvm;
+      memset(p + ((data & 0x0f) << 4), 0x00, 16);
+      erases++;
+      _busyUntilUs = nowUs + tErUs;
+      _eraseEndUs = _busyUntilUs;
+    }
+    break;
+  default:
+    reg[address] = data;
+    break;
+  }
+}
+
+/**
+ * Control Byteの後のデータ受信
+ *
+ * 1byte目はword address, 2byte目以降はデータ
+ * @return 0:ACK 1:NACK
+ */
+int Slg46826Sim::write(uint64_t nowUs, int block, const uint8_t *data,
+                       int length) {
+  uint8_t *p = memory(block);
+  if ((p == NULL) || busy(nowUs)) {
+    return 1;
+  }
+  if (length == 0) {
+    return 0;
+  }
+  _pointer = data[0];
+
+  if (p == reg) {
+    for (int i = 1; i < length; i++) {
+      writeResister(nowUs, _pointer++, data[i]);
+    }
+    return 0;
+  }
+
+  if ((length > 1) && (noiseWrites > 0)) {
+    // 雑音でデータが壊れたpage writeはNACKにして書き込まない
+    if (noiseAfter > 0) {
+      noiseAfter--;
+    } else {
+      noiseWrites--;
+      return 1;
+    }
+  }
+  if (length > 1) {
+    // page write: page内でaddressが一巡する
+    // クリア直後で安定していなければ書き込まれない(読み出して確認するまで分からない)
+    bool settled = (nowUs >= _eraseEndUs + tSettleUs);
+    if (((reg[0xE1] & 0x02) == 0) && settled) {
+      uint8_t page = _pointer & 0xf0;
+      for (int i = 1; i < length; i++) {
+        p[page | ((_pointer + i - 1) & 0x0f)] |= data[i];
+      }
+      writes++;
+      _busyUntilUs = nowUs + tWrUs;
+    }
+  }
+  return 0;
+}
+
+/**
+ * 現在のword addressからの読み出し
+ *
+ * @return 0:ACK 1:NACK
+ */
+int Slg46826Sim::read(uint64_t nowUs, int block, uint8_t *data, int length) {
+  uint8_t *p = memory(block);
+  if ((p == NULL) || busy(nowUs)) {
+    return 1;
+  }
+  for (int i = 0; i < length; i++) {
+    if ((p != reg) && (reg[0xE1] & 0x01)) {
+      data[i] = 0x00; // read禁止
+    } else {
+      data[i] = p[_pointer];
+    }
+    _pointer++;
+  }
+  return 0;
+}
+
+//=====================================
+// I2C bus
+//=====================================
+SimBus::SimBus() : maxHz(0), _nowUs(0), _hz(100000) { clearStats(); }
+
+void SimBus::clearStats(void) { memset(&stats, 0, sizeof(stats)); }
+
+Slg46826Sim *SimBus::select(int address) {
+  int controlCode = (address >> 4) & 0x0f;
+  for (size_t i = 0; i < _devices.size(); i++) {
+    if (_devices[i]->controlCode() == controlCode) {
+      return _devices[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * 通信時間を進める
+ *
+ * 1byte=9bit(data+ACK), start/stop condition=1bit分として計算する
+ */
+void SimBus::transfer(int bytes) {
+  uint64_t bits = (uint64_t)bytes * 9 + 2;
+  uint64_t us = (bits * 1000000 + _hz - 1) / _hz;
+  _nowUs += us;
+  stats.busUs += us;
+}
+
+int SimBus::write(int address, const char *data, int length, bool repeated) {
+  (void)repeated;
+  Slg46826Sim *device = select(address);
+  int block = (address >> 1) & 0x07;
+  int ans = 1;
+
+  stats.transactions++;
+  if ((device != NULL) && !overClock()) {
+    ans = device->write(_nowUs, block, (const uint8_t *)data, length);
+  }
+  if (ans != 0) {
+    stats.nacks++;
+    stats.bytesTx += 1;
+    transfer(1);
+  } else {
+    stats.bytesTx += 1 + length;
+    transfer(1 + length);
+  }
+  return ans;
+}
+
+int SimBus::read(int address, char *data, int length, bool repeated) {
+  (void)repeated;
+  Slg46826Sim *device = select(address);
+  int block = (address >> 1) & 0x07;
+  int ans = 1;
+
+  stats.transactions++;
+  if (device != NULL) {
+    ans = device->read(_nowUs, block, (uint8_t *)data, length);
+    for (int i = 0; (ans == 0) && overClock() && (i < length); i += 7) {
+      data[i] ^= 0x01; // 上限clockを超えるとbitが化ける
+    }
+  }
+  stats.bytesTx += 1;
+  if (ans != 0) {
+    stats.nacks++;
+    transfer(1);
+  } else {
+    stats.bytesRx += length;
+    transfer(1 + length);
+  }
+  return ans;
+}
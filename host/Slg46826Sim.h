@@ -0,0 +1,126 @@
+/**
+ * SLG46826 I2C simulator (PC上での動作確認,速度測定用)
+ *
+ * GreenPak.cppのWireに接続して、実機なしでwriteChip(),eraseChip(),
+ * readChip()を動かす。
+ *
+ * <模擬している動作>
+ * - Control Byte: 上位4bit Control Code, Block Address
+ *   (RESISTER_CONFIG/NVM_CONFIG/EEPROM_CONFIG)
+ * - word addressの自動increment(読み出し,書き込み)
+ * - RESISTER 0xC8 bit1: soft reset (NVM -> RESISTERの再読込)
+ * - RESISTER 0xCA bit3-0: slave address(Control Code)
+ * - RESISTER 0xE1: NVM/EEPROMのprotect
+ * - RESISTER 0xE3: page erase
+ * - NVM,EEPROMのpage write(16byte). 消去していないbitは0に戻せない
+ * - tER(page erase), tWR(page write)中はすべてのControl ByteにNACKを返す
+ * - I2C clockに応じた通信時間
+ * - 配線で決まる上限clock(maxHz)を超えると読み出しデータが化け、書き込みはNACK
+ * - 雑音によるpage writeのNACK(noiseAfter回の後、noiseWrites回)
+ * - page erase終了からtSettleUs以内のpage writeはACKを返すが書き込まれない
+ *
+ * @file
+ */
+#ifndef SLG46826SIM_H
+#define SLG46826SIM_H
+
+#include "GreenPakBus.h"
+#include <stdint.h>
+#include <vector>
+
+//=====================================
+// GreenPak 1個分
+//=====================================
+class Slg46826Sim {
+public:
+  explicit Slg46826Sim(int controlCode = 0);
+
+  uint8_t reg[256];    //<! RESISTER
+  uint8_t nvm[256];    //<! NVM
+  uint8_t eeprom[256]; //<! EEPROM
+
+  uint32_t tErUs; //<! page erase時間[us]
+  uint32_t tWrUs; //<! page write時間[us]
+
+  uint32_t noiseAfter;  //<! NACKを返し始めるまでのpage write回数
+  uint32_t noiseWrites; //<! NACKを返すpage write回数(0:雑音なし)
+
+  uint32_t tSettleUs; //<! page erase後に書き込めるようになるまでの時間[us]
+
+  /// 電源投入(NVM -> RESISTER)
+  void powerOn(void);
+
+  /// 現在のControl Code (RESISTER 0xCAの下位4bit)
+  int controlCode(void) const { return reg[0xCA] & 0x0f; }
+
+  /// busy(tER,tWR)中か
+  bool busy(uint64_t nowUs) const { return nowUs < _busyUntilUs; }
+
+  int write(uint64_t nowUs, int block, const uint8_t *data, int length);
+  int read(uint64_t nowUs, int block, uint8_t *data, int length);
+
+  uint32_t erases; //<! page erase回数
+  uint32_t writes; //<! page write回数
+  uint32_t resets; //<! soft reset回数
+
+private:
+  uint8_t *memory(int block);
+  void writeResister(uint64_t nowUs, uint8_t address, uint8_t data);
+
+  uint8_t _pointer;       //<! word address
+  uint64_t _busyUntilUs;  //<! busy終了時刻
+  uint64_t _eraseEndUs;   //<! 最後のpage erase終了時刻
+};
+
+//=====================================
+// I2C bus
+//=====================================
+/**
+ * 複数のSlg46826Simをつないだ I2C bus
+ *
+ * 時間はsimulator内の時刻で、wait_us()と通信時間で進む
+ */
+class SimBus : public GreenPakBus {
+public:
+  SimBus();
+
+  void attach(Slg46826Sim *device) { _devices.push_back(device); }
+  /// 最後にattach()したGreenPakを外す
+  void detach(void) { _devices.pop_back(); }
+
+  virtual void frequency(int hz) { _hz = hz; }
+  virtual int read(int address, char *data, int length, bool repeated = false);
+  virtual int write(int address, const char *data, int length,
+                    bool repeated = false);
+  virtual void stop(void) {}
+
+  virtual void wait_us(uint32_t us) { _nowUs += us; }
+  virtual uint32_t read_us(void) { return (uint32_t)_nowUs; }
+
+  uint64_t nowUs(void) const { return _nowUs; }
+  int hz(void) const { return _hz; }
+
+  int maxHz; //<! 正しく通信できる上限clock[Hz] 0:制限なし
+
+  typedef struct {
+    uint32_t transactions; //<! start conditionの回数
+    uint32_t nacks;        //<! NACKになった回数
+    uint32_t bytesTx;      //<! 送信byte数(Control Byteを含む)
+    uint32_t bytesRx;      //<! 受信byte数
+    uint64_t busUs;        //<! 通信にかかった時間[us]
+  } stats_t;
+
+  stats_t stats;
+  void clearStats(void);
+
+private:
+  Slg46826Sim *select(int address);
+  void transfer(int bytes);
+  bool overClock(void) const { return (maxHz != 0) && (_hz > maxHz); }
+
+  std::vector<Slg46826Sim *> _devices;
+  uint64_t _nowUs;
+  int _hz;
+};
+
+#endif
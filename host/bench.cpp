@@ -0,0 +1,445 @@
+/**
+ * GreenPak書き込み処理のbenchmark (PC上で実行)
+ *
+ * Slg46826Simに対してeraseChip(),writeChip(),readChip()を実行し、
+ * command毎に simulator上のI2C時間, PC上の実行時間, 通信byte数を表示する。
+ * 書き込み後にはsimulatorの内容とHEX fileの内容を比較する。
+ *
+ * usage: gpbench [-v] [-t] [-l level] [-n num] [-d dir] [-f hz] [-m hz] [-ter us] [-twr us]
+ *   -v  : GreenPak処理の表示を出力する
+ *   -t  : 最後に処理ごとの処理時間の集計(mbedのtcommandと同じ)を表示する
+ *   -l  : 表示の詳しさ 0:quiet 1:normal(初期値) 2:verbose
+ *   -n  : 接続するGreenPakの数(初期値 1, Control Code 0x0から順に割り当てる)
+ *   -d  : HEX fileのディレクトリ(初期値 ../greenPakSample/)
+ *   -f  : I2C clock[Hz]を固定する(初期値 0:自動選択)
+ *   -m  : simulatorが正しく通信できる上限clock[Hz](初期値 0:制限なし)
+ *   -ter: page erase時間[us](初期値 20000)
+ *   -twr: page write時間[us](初期値 20000)
+ *
+ * @file
+ */
+#include "GreenPak.h"
+#include "HostConsole.h"
+#include "Slg46826Sim.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+
+//=====================================
+// 接続先
+//=====================================
+SimBus simBus;
+HostConsole hostConsole;
+GreenPakBus &Wire = simBus;
+GreenPakConsole &pc = hostConsole;
+
+static Slg46826Sim devices[16] = {
+    Slg46826Sim(0x0), Slg46826Sim(0x1), Slg46826Sim(0x2), Slg46826Sim(0x3),
+    Slg46826Sim(0x4), Slg46826Sim(0x5), Slg46826Sim(0x6), Slg46826Sim(0x7),
+    Slg46826Sim(0x8), Slg46826Sim(0x9), Slg46826Sim(0xa), Slg46826Sim(0xb),
+    Slg46826Sim(0xc), Slg46826Sim(0xd), Slg46826Sim(0xe), Slg46826Sim(0xf)};
+static Slg46826Sim &device = devices[0];
+static int deviceCount = 1;
+
+//=====================================
+// benchmark
+//=====================================
+/**
+ * 書き込んだ内容の確認
+ *
+ * @return 不一致byte数
+ */
+static int compare(const uint8_t *memory, bool resister) {
+  int ng = 0;
+  for (int i = 0; i < 256; i++) {
+    uint8_t expect = hexData[i >> 4][i & 0x0f];
+    if (resister && (i >= 0xC0)) {
+      continue; // RESISTERの0xC0以降は制御用なので比較しない
+    }
+    if (memory[i] != expect) {
+      ng++;
+    }
+  }
+  return ng;
+}
+
+typedef int (*command_t)(void);
+
+static int cmdErasenNvm(void) { return eraseChip(&session, NVM); }
+static int cmdEraseEeprom(void) { return eraseChip(&session, EEPROM); }
+static int cmdWriteNvm(void) {
+  int ans = writeChip(&session, NVM);
+  return (ans == 0) ? compare(device.nvm, false) : ans;
+}
+static int cmdWriteSwapped(void) {
+  // 書き込み後に同じaddressのprotectされたGreenPakに交換しても書き込める
+  // (NVMの書き込みはslave addressを確認し直すので、EEPROMで確認する)
+  int ans = writeChip(&session, EEPROM);
+  if (ans != 0) {
+    return ans;
+  }
+  memset(device.eeprom, 0x00, sizeof(device.eeprom));
+  device.reg[0xE1] = 0x03;
+  ans = writeChip(&session, EEPROM);
+  return (ans == 0) ? compare(device.eeprom, false) : ans;
+}
+static int cmdWriteEeprom(void) {
+  int ans = writeChip(&session, EEPROM);
+  return (ans == 0) ? compare(device.eeprom, false) : ans;
+}
+static int cmdWriteResister(void) {
+  int ans = writeChip(&session, RESISTER);
+  return (ans == 0) ? compare(device.reg, true) : ans;
+}
+static int cmdUpdateNvm(void) {
+  // 1page分だけ内容の異なるGreenPakへの差分書き込み
+  memset(device.nvm + 0x30, 0x00, 16);
+  int ans = writeChip(&session, NVM, 0xff, true);
+  return (ans == 0) ? compare(device.nvm, false) : ans;
+}
+static int cmdRetryNvm(void) {
+  // page 5の書き込みが雑音で2回NACKになってもretryで書き込める
+  device.noiseAfter = 5;
+  device.noiseWrites = 2;
+  int ans = writeChip(&session, NVM);
+  ans = (ans == 0) ? compare(device.nvm, false) : ans;
+  return ((ans == 0) && (resume.retries[5] == 2)) ? 0 : -1;
+}
+static int cmdResumeNvm(void) {
+  // retryなしでpage 7の書き込みに失敗し、page 7から続ける
+  // (clockを固定して、1段階遅いclockでのやり直しもしない)
+  int retries = pageRetries;
+  int pinnedHz = busPinnedHz;
+  pageRetries = 0;
+  busPinnedHz = busHz;
+  device.noiseAfter = 7;
+  device.noiseWrites = 1;
+  int ans = writeChip(&session, NVM);
+  pageRetries = retries;
+  busPinnedHz = pinnedHz;
+  if ((ans == 0) || !resume.pending || (resume.failedPage != 7)) {
+    return -1;
+  }
+  uint32_t erases = device.erases;
+  uint32_t writes = device.writes;
+  ans = writeResume(&session);
+  ans = (ans == 0) ? compare(device.nvm, false) : ans;
+  // page 7をクリアし直し、page 7～15だけを書き込む
+  return ((ans == 0) && (device.erases - erases == 1) &&
+          (device.writes - writes == 9))
+             ? 0
+             : -1;
+}
+static int cmdBlankNvm(void) { return blankCheck(&session, NVM); }
+static int cmdVerifyNvm(void) { return verifyChip(&session, NVM); }
+static int cmdVerifyEeprom(void) { return verifyChip(&session, EEPROM); }
+static int cmdVerifyBus(void) {
+  // 読み出しが化けるclockでは、1段階遅いclockで読み直して一致する
+  int hz = busHz;
+  int maxHz = simBus.maxHz;
+  simBus.maxHz = hz / 2;
+  int ans = verifyChip(&session, NVM);
+  ans = ((ans == 0) && (busHz < hz)) ? 0 : -1;
+  simBus.maxHz = maxHz;
+  busHz = hz;
+  Wire.frequency(busHz);
+  return ans;
+}
+static int cmdVerifyDiff(void) {
+  // GreenPakの内容が違うだけではclockを遅くしない
+  int hz = busHz;
+  device.nvm[0x10] ^= 0xff;
+  int ans = verifyChip(&session, NVM);
+  device.nvm[0x10] ^= 0xff;
+  return ((ans == -1) && (verifyLast.mismatches == 1) && (busHz == hz)) ? 0
+                                                                       : -1;
+}
+static int cmdReadNvm(void) { return readChip(&session, NVM); }
+static int cmdReadEeprom(void) { return readChip(&session, EEPROM); }
+static int cmdReadResister(void) { return readChip(&session, RESISTER); }
+static int gangNvm(int count) {
+  int ans = gangWrite(NVM);
+  for (int i = 0; (ans == 0) && (i < count); i++) {
+    // 0xCAはそれぞれのslave addressになる
+    hexData[0xC][0xA] = (hexData[0xC][0xA] & 0xF0) | i;
+    ans = compare(devices[i].nvm, false);
+  }
+  return ans;
+}
+static int cmdGangNvm(void) { return gangNvm(deviceCount); }
+static int cmdGangRetry(void) {
+  // 一括書き込みでもpage 5の書き込みが雑音で2回NACKになってもretryで書き込める
+  device.noiseAfter = 5;
+  device.noiseWrites = 2;
+  return gangNvm(deviceCount);
+}
+static int cmdGangSettle(void) {
+  // クリアの50ms後まで書き込めないGreenPak(2個以上)への一括書き込み,確認
+  // 確認で不一致にならず、I2C clockも下がらない
+  bool extra = (deviceCount == 1);
+  int count = extra ? 2 : deviceCount;
+  if (extra) {
+    simBus.attach(&devices[1]);
+  }
+  for (int i = 0; i < count; i++) {
+    devices[i].tSettleUs = 50000;
+  }
+  bool verify = autoVerify;
+  int hz = busHz;
+  autoVerify = true;
+  int ans = gangNvm(count);
+  ans = ((ans == 0) && (busHz == hz)) ? 0 : -1;
+  autoVerify = verify;
+  for (int i = 0; i < count; i++) {
+    devices[i].tSettleUs = 0;
+  }
+  if (extra) {
+    simBus.detach();
+  }
+  return ans;
+}
+static int cmdCloneNvm(void) {
+  // device 0を複製元にする. 1個だけなら差し替えたGreenPakに書き込む
+  uint8_t golden[256];
+  memcpy(golden, device.nvm, sizeof(golden));
+  int ans = cloneChip(NVM, 0);
+  if ((ans == 0) && (deviceCount == 1)) {
+    memset(device.nvm, 0x00, sizeof(device.nvm));
+    device.powerOn();
+    deviceInvalidate(&session);
+    ans = writeChip(&session, NVM);
+  }
+  for (int i = 0; (ans == 0) && (i < deviceCount); i++) {
+    golden[0xCA] = (golden[0xCA] & 0xF0) | i; // 0xCAはそれぞれのslave address
+    ans = (memcmp(devices[i].nvm, golden, sizeof(golden)) == 0) ? 0 : -1;
+  }
+  ramImageClear();
+  return ans;
+}
+static int cmdLibrary(void) {
+  // slot 0,1に読み込み、NVMのslotを選んで書き込む
+  if ((libraryLoad(0, NVM, "NVM.hex") != 0) ||
+      (libraryLoad(1, EEPROM, "EEPROM.hex") != 0)) {
+    return -1;
+  }
+  memset(device.nvm, 0x00, sizeof(device.nvm));
+  int ans = libraryProgram(&session, 0);
+  ans = (ans == 0) ? compare(device.nvm, false) : ans;
+  ramImageClear();
+  return ans;
+}
+static int cmdDevice(void) {
+  // EEPROMのないSLG46824ではEEPROMを操作しない
+  deviceSelect(GPB_DEVICE_SLG46824);
+  int ans = ((eraseChip(&session, EEPROM) == -1) &&
+             (readBlock(session.slaveAddress, EEPROM, chipData) == -1))
+                ? 0
+                : -1;
+  // 型番(SLG46827)を指定したimageで書き込むと、その型番になる
+  if ((ans == 0) && (imageRead(NVM) == 256)) {
+    ramImage_t *ram = &ramImage[0];
+    memcpy(ram->data, hexData, sizeof(ram->data));
+    ram->slaveAddress = 0xff;
+    ram->deviceId = GPB_DEVICE_SLG46827;
+    ram->pages = 0xffff;
+    ram->valid = true;
+    memset(device.nvm, 0x00, sizeof(device.nvm));
+    ans = writeChip(&session, NVM);
+    ans = ((ans == 0) && (deviceType == GPB_DEVICE_SLG46827))
+              ? compare(device.nvm, false)
+              : -1;
+  }
+  ramImageClear();
+  deviceSelect(GPB_DEVICE_SLG46826);
+  return ans;
+}
+static int cmdProduction(void) {
+  // 量産モードで2個書き込んだ場合(差し込み,取り外しは省略)
+  productionClear();
+  if (productionBegin(false) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < 2; i++) {
+    memset(device.nvm, 0x00, sizeof(device.nvm)); // 新しいGreenPak
+    device.powerOn();
+    deviceInvalidate(&session);
+    productionPart(&session);
+  }
+  productionEnd();
+  productionPrint();
+  return (production.passed == 2) ? 0 : -1;
+}
+/**
+ * バックグラウンド処理の実行(mbedのmain()のloopの代わり)
+ *
+ * @param[in] int abortAt: このpage数を処理したら中断する(-1:中断しない)
+ */
+static int runJob(jobType_t type, greenPakMemory_t memoryType, int abortAt) {
+  if (jobStart(type, &session, memoryType) != 0) {
+    return -1;
+  }
+  while (jobStep()) {
+    if (job.done == abortAt) {
+      jobAbort();
+    }
+    Wire.wait_us(50); // main()のloop 1回分
+  }
+  return job.result;
+}
+static int cmdJobWriteNvm(void) {
+  int ans = runJob(JOB_WRITE, NVM, -1);
+  return (ans == 0) ? compare(device.nvm, false) : ans;
+}
+static int cmdJobRetry(void) {
+  // バックグラウンド処理でもpage 5の書き込みをretryで書き込める
+  device.noiseAfter = 5;
+  device.noiseWrites = 2;
+  int ans = runJob(JOB_WRITE, NVM, -1);
+  ans = (ans == 0) ? compare(device.nvm, false) : ans;
+  return ((ans == 0) && (resume.retries[5] == 2)) ? 0 : -1;
+}
+static int cmdJobAbort(void) {
+  // 途中で中断すると異常終了になり、残りのpageは書き込まれない
+  int ans = runJob(JOB_WRITE, EEPROM, 8);
+  return ((ans != 0) && job.abort && (job.done == 8)) ? 0 : -1;
+}
+static int cmdSettle(void) {
+  // NVMは許可しなければ書き換えない
+  uint32_t erases = device.erases;
+  if ((settleCalibrate(&session, NVM) == 0) || (device.erases != erases)) {
+    return -1;
+  }
+  // クリアの50ms後まで書き込めないGreenPakでは、クリア後の待ちだけが残る
+  // (最短の値の2倍を残すので、他は最短の試した値(Z_settleMinUs)の2倍未満)
+  device.tSettleUs = 50000;
+  int ans = settleCalibrate(&session);
+  ans = (ans == 0) ? compare(device.eeprom, false) : ans;
+  if ((ans == 0) &&
+      ((settle.us[SETTLE_READY] >= 2 * Z_settleMinUs) ||
+       (settle.us[SETTLE_GAP] >= 2 * Z_settleMinUs) ||
+       (settle.us[SETTLE_ERASE] < 2 * device.tSettleUs) ||
+       (settleUs(SETTLE_ERASE) >= Z_settleEraseUs))) {
+    ans = -1;
+  }
+  device.tSettleUs = 0;
+  settleDefault();
+  return ans;
+}
+static int cmdPing(void) {
+  ping();
+  return 0;
+}
+
+static const struct {
+  const char *name;
+  command_t command;
+} commands[] = {
+    {"p", cmdPing},           {"bn", cmdBlankNvm},
+    {"en", cmdErasenNvm},
+    {"ee", cmdEraseEeprom},   {"wn", cmdWriteNvm},
+    {"ws", cmdWriteSwapped},
+    {"we", cmdWriteEeprom},   {"wr", cmdWriteResister},
+    {"un", cmdUpdateNvm},     {"wt", cmdRetryNvm},
+    {"wc", cmdResumeNvm},     {"vn", cmdVerifyNvm},
+    {"ve", cmdVerifyEeprom},  {"vb", cmdVerifyBus},
+    {"vd", cmdVerifyDiff},
+    {"rn", cmdReadNvm},       {"re", cmdReadEeprom},
+    {"rr", cmdReadResister},  {"gn", cmdGangNvm},
+    {"gt", cmdGangRetry},     {"gs", cmdGangSettle},
+    {"cn", cmdCloneNvm},      {"il", cmdLibrary},
+    {"n", cmdDevice},         {"m", cmdProduction},
+    {"jwn", cmdJobWriteNvm},  {"jt", cmdJobRetry},
+    {"jk", cmdJobAbort},
+    {"oc", cmdSettle},
+};
+
+int main(int argc, char **argv) {
+  int hz = 0;
+  bool tracing = false;
+  localDir = "../greenPakSample/";
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      hostConsole.enable = true;
+    } else if (strcmp(argv[i], "-t") == 0) {
+      tracing = true;
+    } else if ((strcmp(argv[i], "-l") == 0) && (i + 1 < argc)) {
+      hostConsole.level = (consoleLevel_t)atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+      deviceCount = atoi(argv[++i]);
+      if ((deviceCount < 1) || (16 < deviceCount)) {
+        deviceCount = 1;
+      }
+    } else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+      localDir = argv[++i];
+    } else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc)) {
+      hz = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-m") == 0) && (i + 1 < argc)) {
+      simBus.maxHz = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-ter") == 0) && (i + 1 < argc)) {
+      uint32_t us = atoi(argv[++i]);
+      for (int j = 0; j < 16; j++) {
+        devices[j].tErUs = us;
+      }
+    } else if ((strcmp(argv[i], "-twr") == 0) && (i + 1 < argc)) {
+      uint32_t us = atoi(argv[++i]);
+      for (int j = 0; j < 16; j++) {
+        devices[j].tWrUs = us;
+      }
+    } else {
+      fprintf(stderr,
+              "usage: %s [-v] [-t] [-l level] [-n num] [-d dir] [-f hz] [-m hz] "
+              "[-ter us] [-twr us]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  for (int i = 0; i < deviceCount; i++) {
+    simBus.attach(&devices[i]);
+  }
+  if (busPin(hz) != 0) {
+    return 2;
+  }
+
+  printf("I2C %s, tER %u us, tWR %u us, %d devices\n",
+         (hz != 0) ? "pinned" : "auto", device.tErUs, device.tWrUs,
+         deviceCount);
+  printf("%-4s %6s %12s %10s %8s %8s %8s %6s %8s\n", "cmd", "result",
+         "bus[ms]", "wall[ms]", "trans", "tx", "rx", "nack", "console");
+
+  int failed = 0;
+  uint64_t totalUs = 0;
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    simBus.clearStats();
+    hostConsole.bytes = 0;
+    traceBegin();
+    uint64_t start = simBus.nowUs();
+    std::chrono::steady_clock::time_point wallStart =
+        std::chrono::steady_clock::now();
+
+    int ans = commands[i].command();
+
+    double wallMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - wallStart)
+                        .count();
+    uint64_t us = simBus.nowUs() - start;
+    totalUs += us;
+    if (ans != 0) {
+      failed++;
+    }
+    printf("%-4s %6s %12.3f %10.3f %8u %8u %8u %6u %8u\n", commands[i].name,
+           (ans == 0) ? "OK" : "NG", us / 1000.0, wallMs,
+           simBus.stats.transactions, simBus.stats.bytesTx,
+           simBus.stats.bytesRx, simBus.stats.nacks, hostConsole.bytes);
+  }
+  printf("total %.3f ms (simulated), I2C %d Hz %u byte/s\n", totalUs / 1000.0,
+         busHz, busBytesPerSec);
+  if (tracing) {
+    // 最後のcommandの記録と、全commandの集計
+    hostConsole.enable = true;
+    hostConsole.level = CONSOLE_QUIET;
+    tracePrint(false);
+  }
+  return (failed == 0) ? 0 : 1;
+}
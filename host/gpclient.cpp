@@ -0,0 +1,247 @@
+/**
+ * mbedとのbinary通信 PC側のcommand (PC上で実行)
+ *
+ * mbedのUSB-Serialに接続し、textの"x"commandでbinary通信に切り替えてから、
+ * 書き込みデータの転送,書き込み,確認,読み出しを行う。
+ * mbedのUSBドライブへのHEX fileのcopyは不要になる
+ *
+ * usage: gpclient [-p port] [-b baud] command...
+ *   -p : serial port(初期値 /dev/ttyACM0)
+ *   -b : baudrate(初期値 115200)
+ * command(textのcommandと同じ名前, 書いた順に実行する)
+ *   ln file: NVM,RESISTER用の書き込みデータ(.hex,.gpb)を転送
+ *   le file: EEPROM用の書き込みデータ(.hex,.gpb)を転送
+ *   wnx,we,wr: 書き込み(xはslave address 0～f, 省略時は現状のaddressを継承)
+ *   unx,ue,ur: 差分書き込み
+ *   vn,ve,vr: 書き込み内容の確認
+ *   rn,re,rr: 読み出し
+ *   s: 状態表示
+ *
+ * 例: gpclient ln NVM.hex wn vn
+ *
+ * @file
+ */
+#include "GpClient.h"
+#include "GreenPak.h"
+#include "GreenPakProtocol.h"
+#include "HostConsole.h"
+#include "Slg46826Sim.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+//=====================================
+// 接続先(書き込みデータの読み込みだけに使う)
+//=====================================
+SimBus simBus;
+HostConsole hostConsole;
+GreenPakBus &Wire = simBus;
+GreenPakConsole &pc = hostConsole;
+
+/**
+ * serial port
+ */
+class SerialPortLink : public GreenPakLink {
+public:
+  SerialPortLink() : _fd(-1) {}
+  ~SerialPortLink() {
+    if (_fd >= 0) {
+      close(_fd);
+    }
+  }
+
+  int open(const char *port, int baud) {
+    _fd = ::open(port, O_RDWR | O_NOCTTY);
+    if (_fd < 0) {
+      return -1;
+    }
+    struct termios tio;
+    tcgetattr(_fd, &tio);
+    cfmakeraw(&tio);
+    speed_t speed = B115200;
+    switch (baud) {
+    case 9600:
+      speed = B9600;
+      break;
+    case 57600:
+      speed = B57600;
+      break;
+    case 230400:
+      speed = B230400;
+      break;
+    default:
+      break;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tcsetattr(_fd, TCSANOW, &tio);
+    tcflush(_fd, TCIOFLUSH);
+    return 0;
+  }
+
+  virtual int readable(void) {
+    struct pollfd pfd = {_fd, POLLIN, 0};
+    return (poll(&pfd, 1, 10) > 0) && (pfd.revents & POLLIN);
+  }
+  virtual int getc(void) {
+    uint8_t data = 0;
+    return (::read(_fd, &data, 1) == 1) ? data : -1;
+  }
+  virtual void write(const char *data, int length) {
+    while (length > 0) {
+      ssize_t n = ::write(_fd, data, length);
+      if (n <= 0) {
+        break;
+      }
+      data += n;
+      length -= n;
+    }
+  }
+
+private:
+  int _fd;
+};
+
+/**
+ * 書き込みデータ(.gpb または .hex)の読み込み
+ *
+ * @return 0:正常終了 -1:異常終了
+ */
+static int loadImage(const char *name, greenPakMemory_t target,
+                     uint8_t data[16][16]) {
+  FILE *fp = fopen(name, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: %s\n", name, hexErrorText(HEX_ERR_FILE));
+    return -1;
+  }
+  gpbImage_t image;
+  int size = fread(&image, 1, sizeof(image), fp);
+  int ans = HEX_ERR_FORMAT;
+  if ((size == (int)sizeof(image)) && (fgetc(fp) == EOF) &&
+      (memcmp(image.header.magic, GPB_MAGIC, 4) == 0)) {
+    ans = gpbDecode(&image, target);
+  } else {
+    hexParser_t hp;
+    char line[600];
+    rewind(fp);
+    hexParseBegin(&hp);
+    ans = HEX_OK;
+    while ((ans == HEX_OK) && (fgets(line, sizeof(line), fp) != NULL)) {
+      ans = hexParseLine(&hp, line, false);
+    }
+    if (ans == HEX_OK) {
+      ans = hexParseEnd(&hp);
+    }
+    if ((ans == HEX_OK) && (hp.bytes != 256)) {
+      ans = HEX_ERR_LENGTH;
+    }
+  }
+  fclose(fp);
+  if (ans != HEX_OK) {
+    fprintf(stderr, "%s: %s\n", name, hexErrorText(ans));
+    return -1;
+  }
+  memcpy(data, hexData, 256);
+  return 0;
+}
+
+static greenPakMemory_t memoryOf(char c) {
+  return (c == 'e') ? EEPROM : ((c == 'r') ? RESISTER : NVM);
+}
+
+int main(int argc, char **argv) {
+  const char *port = "/dev/ttyACM0";
+  int baud = 115200;
+  int i = 1;
+
+  for (; i < argc; i++) {
+    if ((strcmp(argv[i], "-p") == 0) && (i + 1 < argc)) {
+      port = argv[++i];
+    } else if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc)) {
+      baud = atoi(argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if (i >= argc) {
+    fprintf(stderr, "usage: %s [-p port] [-b baud] command...\n", argv[0]);
+    return 2;
+  }
+
+  SerialPortLink link;
+  if (link.open(port, baud) != 0) {
+    fprintf(stderr, "%s: open error\n", port);
+    return 1;
+  }
+  // 入力途中のcommandを終わらせてからbinary通信に切り替える
+  link.write("\rx\r", 3);
+
+  GpClient client(link);
+  GpClient::response_t response;
+  int failed = 0;
+
+  for (; (i < argc) && (failed == 0); i++) {
+    const char *cmd = argv[i];
+    uint8_t data[16][16];
+    int ans = PROTO_ERR_COMMAND;
+    int mismatches = 0;
+
+    switch (cmd[0]) {
+    case 'l':
+      if (i + 1 < argc) {
+        greenPakMemory_t target = memoryOf(cmd[1]);
+        const char *name = argv[++i];
+        ans = (loadImage(name, target, data) == 0) ? client.upload(target, data)
+                                                   : PROTO_NG;
+      }
+      break;
+    case 'w':
+    case 'u':
+      ans = client.write(memoryOf(cmd[1]),
+                         (cmd[1] && cmd[2]) ? strtoul(&cmd[2], NULL, 16) & 0x0f
+                                            : 0xff,
+                         cmd[0] == 'u');
+      break;
+    case 'v':
+      ans = client.verify(memoryOf(cmd[1]), &mismatches);
+      printf("%s: %d mismatches\n", cmd, mismatches);
+      break;
+    case 'r':
+      ans = client.read(memoryOf(cmd[1]), data);
+      for (int j = 0; (ans == PROTO_OK) && (j < 16); j++) {
+        printf("%02x :", j);
+        for (int k = 0; k < 16; k++) {
+          printf("%02x ", data[j][k]);
+        }
+        printf("\n");
+      }
+      break;
+    case 's':
+      ans = client.status(&response);
+      if (ans == PROTO_OK) {
+        printf("slave address = 0x%02x%s, I2C %lu Hz, ram image = %d, "
+               "auto verify = %d\n",
+               response.payload[2], response.payload[1] ? "" : "(not found)",
+               (unsigned long)(response.payload[3] |
+                               (response.payload[4] << 8) |
+                               (response.payload[5] << 16) |
+                               ((uint32_t)response.payload[6] << 24)),
+               response.payload[7], response.payload[8]);
+      }
+      break;
+    default:
+      break;
+    }
+    printf("%s %s\n", cmd, (ans == PROTO_OK) ? "OK" : "NG");
+    if (ans != PROTO_OK) {
+      failed++;
+    }
+  }
+
+  client.end();
+  printf("%u frames, %u naks\n", client.sent, client.naks);
+  return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/**
+ * Intel HEX file -> binary image file(.gpb) 変換 (PC上で実行)
+ *
+ * GreenPak.cppのHEX file解析(hexParseLine())で読み込み、gpbEncode()で変換する
+ *
+ * usage: hex2gpb [-e|-r] [-a x] [-d xx] input.hex output.gpb
+ *   -e : EEPROM用 (初期値はNVM用)
+ *   -r : RESISTER用
+ *   -a : NVM書き込み時のslave address x=0～f (初期値: 指定なし)
+ *   -d : 型番 xx=24:SLG46824, 26:SLG46826(初期値), 27:SLG46827
+ *        (mbedはこのimageを読み込むと、この型番として書き込む)
+ *
+ * 例: hex2gpb ../greenPakSample/NVM.hex NVM.gpb
+ *
+ * @file
+ */
+#include "GreenPak.h"
+#include "HostConsole.h"
+#include "Slg46826Sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+//=====================================
+// 接続先(使わない)
+//=====================================
+SimBus simBus;
+HostConsole hostConsole;
+GreenPakBus &Wire = simBus;
+GreenPakConsole &pc = hostConsole;
+
+int main(int argc, char **argv) {
+  greenPakMemory_t target = NVM;
+  uint8_t slaveAddress = 0xff;
+  const char *input = NULL;
+  const char *output = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-e") == 0) {
+      target = EEPROM;
+    } else if (strcmp(argv[i], "-r") == 0) {
+      target = RESISTER;
+    } else if ((strcmp(argv[i], "-a") == 0) && (i + 1 < argc)) {
+      slaveAddress = strtoul(argv[++i], NULL, 16) & 0x0f;
+    } else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+      if (deviceSelect(strtoul(argv[++i], NULL, 16)) != 0) {
+        fprintf(stderr, "%s: unknown device\n", argv[i]);
+        return 2;
+      }
+    } else if (input == NULL) {
+      input = argv[i];
+    } else if (output == NULL) {
+      output = argv[i];
+    } else {
+      input = NULL;
+      break;
+    }
+  }
+  if ((input == NULL) || (output == NULL)) {
+    fprintf(stderr, "usage: %s [-e|-r] [-a x] [-d xx] input.hex output.gpb\n",
+            argv[0]);
+    return 2;
+  }
+
+  FILE *fp = fopen(input, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "%s: %s\n", input, hexErrorText(HEX_ERR_FILE));
+    return 1;
+  }
+  hexParser_t hp;
+  char line[600];
+  int ans = HEX_OK;
+  hexParseBegin(&hp);
+  while ((ans == HEX_OK) && (fgets(line, sizeof(line), fp) != NULL)) {
+    ans = hexParseLine(&hp, line, false);
+  }
+  fclose(fp);
+  if (ans == HEX_OK) {
+    ans = hexParseEnd(&hp);
+  }
+  if (ans != HEX_OK) {
+    fprintf(stderr, "%s: line %d %s\n", input, hp.line, hexErrorText(ans));
+    return 1;
+  }
+  if (hp.bytes != 256) {
+    fprintf(stderr, "%s: %d bytes (256 bytes required)\n", input, hp.bytes);
+    return 1;
+  }
+
+  gpbImage_t image;
+  gpbEncode(&image, target, slaveAddress);
+
+  fp = fopen(output, "wb");
+  if ((fp == NULL) || (fwrite(&image, sizeof(image), 1, fp) != 1)) {
+    fprintf(stderr, "%s: write error\n", output);
+    return 1;
+  }
+  fclose(fp);
+  printf("%s -> %s (%d records, %u bytes)\n", input, output, hp.records,
+         (unsigned)sizeof(image));
+  return 0;
+}
@@ -0,0 +1,711 @@
+/**
+ * HEX file解析(hexParseLine())の試験とbenchmark (PC上で実行)
+ *
+ * 変換表で変換するhexParseLine()(hexDecode())と、atoh1()で1文字ずつ変換する
+ * 参照用の解析(refParseLine(), 変換表にする前のhexParseLine()と同じ処理)に
+ * 同じ入力を与え、結果(エラー,解析状態,hexData[][],hexPresent[])が
+ * 全て一致することを確認する。
+ *  1. 全ての2文字の組み合わせでhexDecode()とatoh2()の変換結果が一致する
+ *  2. 乱数で作った正常なHEX file(record長,address順,拡張address,小文字,
+ *     改行,空行がばらばら)を両方が同じ内容で読み込める
+ *  3. 壊したHEX file(文字の置換,削除,追加, checksum,byte数,address,typeの異常,
+ *     end of fileの前後, 0以外の拡張address)を両方が同じエラーで受け付けない.
+ *     address空間の最後付近の拡張addressとdata record(address + byte数が
+ *     一巡する組み合わせ)は決まった入力でも確認する
+ *  4. hexFormat()(dn,de,drでの保存)で作ったHEX fileを元の内容で読み込める.
+ *     GreenPAK DesignerのHEX file(-dのNVM.hex)と同じ文字列になる
+ *  5. 大きなHEX fileの解析速度[record/s]を両方で測る
+ *
+ * usage: hextest [-n count] [-s seed] [-b records] [-d dir]
+ *   -n : 乱数で作るHEX fileの数(初期値 20000)
+ *   -s : 乱数の種(初期値 1)
+ *   -b : benchmarkのrecord数(初期値 200000, 0:benchmarkしない)
+ *   -d : HEX fileのディレクトリ(初期値 ../greenPakSample/)
+ *
+ * @file
+ */
+#include "GreenPak.h"
+#include "HostConsole.h"
+#include "Slg46826Sim.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//=====================================
+// 接続先(使わない)
+//=====================================
+SimBus simBus;
+HostConsole hostConsole;
+GreenPakBus &Wire = simBus;
+GreenPakConsole &pc = hostConsole;
+
+//=====================================
+// 参照用の解析
+//=====================================
+/**
+ * 変換表にする前のHEX fileの1byte分の変換(atoh1()で1文字ずつ変換する)
+ */
+static int refByte(const char *p) {
+  uint8_t up = atoh1((char *)p);
+  uint8_t dn = atoh1((char *)p + 1);
+  if ((up == 0xff) || (dn == 0xff)) {
+    return -1;
+  }
+  return (up << 4) | dn;
+}
+
+/**
+ * 変換表にする前のhexParseLine() (verboseの表示は省略)
+ */
+static int refParseLine(hexParser_t *hp, const char *line) {
+  uint8_t record[4 + 255 + 1];
+  int length = 0;
+  const char *p = line;
+
+  hp->line++;
+
+  int chars = strlen(line);
+  while ((chars > 0) && ((unsigned char)line[chars - 1] <= ' ')) {
+    chars--;
+  }
+  if (chars == 0) {
+    return HEX_OK;
+  }
+  if (hp->eof) {
+    return HEX_ERR_AFTER_EOF;
+  }
+  if ((*p++ != ':') || ((chars & 1) == 0)) {
+    return HEX_ERR_FORMAT;
+  }
+
+  uint8_t sum = 0;
+  for (int i = 1; i < chars; i += 2) {
+    if (length >= (int)sizeof(record)) {
+      return HEX_ERR_LENGTH;
+    }
+    int data = refByte(p);
+    if (data < 0) {
+      return HEX_ERR_FORMAT;
+    }
+    record[length++] = data;
+    sum += data;
+    p += 2;
+  }
+  if ((length < 5) || (record[0] != length - 5)) {
+    return HEX_ERR_LENGTH;
+  }
+  if (sum != 0) {
+    return HEX_ERR_CHECKSUM;
+  }
+
+  uint8_t byteCount = record[0];
+  uint32_t address = (record[1] << 8) | record[2];
+  uint8_t *data = &record[4];
+
+  switch (record[3]) {
+  case 0x00:
+    if ((hp->base != 0) || (address > 0x100u - byteCount)) {
+      return HEX_ERR_RANGE;
+    }
+    for (int i = 0; i < byteCount; i++, address++) {
+      uint8_t bit = 1 << (address & 0x07);
+      if (hexPresent[address >> 3] & bit) {
+        return HEX_ERR_OVERLAP;
+      }
+      hexPresent[address >> 3] |= bit;
+      hexData[address >> 4][address & 0x0f] = data[i];
+    }
+    hp->records++;
+    hp->bytes += byteCount;
+    break;
+  case 0x01:
+    if (byteCount != 0) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->eof = true;
+    break;
+  case 0x02:
+    if (byteCount != 2) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->base = (uint32_t)((data[0] << 8) | data[1]) << 4;
+    break;
+  case 0x04:
+    if (byteCount != 2) {
+      return HEX_ERR_LENGTH;
+    }
+    hp->base = (uint32_t)((data[0] << 8) | data[1]) << 16;
+    break;
+  case 0x03:
+  case 0x05:
+    break;
+  default:
+    return HEX_ERR_TYPE;
+  }
+  return HEX_OK;
+}
+
+static int newParseLine(hexParser_t *hp, const char *line) {
+  return hexParseLine(hp, line, false);
+}
+
+typedef int (*parseLine_t)(hexParser_t *hp, const char *line);
+
+/**
+ * 解析結果
+ */
+typedef struct {
+  int ans;
+  hexParser_t hp;
+  uint8_t data[16][16];
+  uint8_t present[32];
+} parseResult_t;
+
+/**
+ * HEX file全体の解析(hexFileRead()と同じく'\n'で区切る)
+ */
+static void parseFile(const std::string &text, parseLine_t parseLine,
+                      parseResult_t *result) {
+  std::vector<char> buffer(text.begin(), text.end());
+  buffer.push_back('\0');
+
+  hexParseBegin(&result->hp);
+  int ans = HEX_OK;
+  char *line = &buffer[0];
+  while ((ans == HEX_OK) && (*line != '\0')) {
+    char *next = strchr(line, '\n');
+    if (next != NULL) {
+      *next++ = '\0';
+    } else {
+      next = line + strlen(line);
+    }
+    ans = parseLine(&result->hp, line);
+    line = next;
+  }
+  if (ans == HEX_OK) {
+    ans = hexParseEnd(&result->hp);
+  }
+  result->ans = ans;
+  memcpy(result->data, hexData, sizeof(hexData));
+  memcpy(result->present, hexPresent, sizeof(hexPresent));
+}
+
+static bool sameResult(const parseResult_t &a, const parseResult_t &b) {
+  return (a.ans == b.ans) && (a.hp.base == b.hp.base) &&
+         (a.hp.line == b.hp.line) && (a.hp.records == b.hp.records) &&
+         (a.hp.bytes == b.hp.bytes) && (a.hp.eof == b.hp.eof) &&
+         (memcmp(a.data, b.data, sizeof(a.data)) == 0) &&
+         (memcmp(a.present, b.present, sizeof(a.present)) == 0);
+}
+
+//=====================================
+// HEX fileの作成
+//=====================================
+static uint32_t randomState = 1;
+
+/**
+ * 乱数(xorshift32, 種が同じなら毎回同じ列になる)
+ */
+static uint32_t random32(void) {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static int randomInt(int n) { return random32() % n; }
+
+/**
+ * 1 record分の文字列
+ */
+static std::string record(int type, int address, const uint8_t *data,
+                          int count, bool lower) {
+  const char *digits = lower ? "0123456789abcdef" : "0123456789ABCDEF";
+  uint8_t bytes[4 + 255 + 1];
+  bytes[0] = count;
+  bytes[1] = address >> 8;
+  bytes[2] = address & 0xff;
+  bytes[3] = type;
+  memcpy(&bytes[4], data, count);
+  uint8_t sum = 0;
+  for (int i = 0; i < 4 + count; i++) {
+    sum += bytes[i];
+  }
+  bytes[4 + count] = -sum;
+
+  std::string text = ":";
+  for (int i = 0; i < 5 + count; i++) {
+    text += digits[bytes[i] >> 4];
+    text += digits[bytes[i] & 0x0f];
+  }
+  return text;
+}
+
+/**
+ * 乱数で作る正常なHEX file
+ *
+ * 256byteをばらばらの長さのrecordに分け、順番を入れ替えて書く
+ */
+typedef struct {
+  std::vector<std::string> lines; //<! 改行なしの各行
+  uint8_t image[256];             //<! 書いた内容
+} hexFile_t;
+
+static void makeFile(hexFile_t *file) {
+  bool lower = (randomInt(4) == 0);
+  for (int i = 0; i < 256; i++) {
+    file->image[i] = random32();
+  }
+
+  std::vector<std::pair<int, int> > chunks; // address, byte数
+  int maxCount = (randomInt(2) == 0) ? 16 : 1 + randomInt(64);
+  for (int address = 0; address < 256;) {
+    int count = 1 + randomInt(maxCount);
+    if (address + count > 256) {
+      count = 256 - address;
+    }
+    chunks.push_back(std::make_pair(address, count));
+    address += count;
+  }
+  if (randomInt(2) == 0) {
+    for (size_t i = chunks.size() - 1; i > 0; i--) {
+      std::swap(chunks[i], chunks[randomInt(i + 1)]);
+    }
+  }
+
+  file->lines.clear();
+  uint8_t zero[2] = {0x00, 0x00};
+  if (randomInt(3) == 0) {
+    file->lines.push_back(record(randomInt(2) ? 0x02 : 0x04, 0, zero, 2, lower));
+  }
+  for (size_t i = 0; i < chunks.size(); i++) {
+    file->lines.push_back(record(0x00, chunks[i].first,
+                                 &file->image[chunks[i].first],
+                                 chunks[i].second, lower));
+    if (randomInt(32) == 0) {
+      file->lines.push_back(""); // 空行
+    }
+  }
+  if (randomInt(4) == 0) {
+    uint8_t start[4] = {0x00, 0x00, 0x00, 0x00};
+    file->lines.push_back(record(randomInt(2) ? 0x03 : 0x05, 0, start, 4, lower));
+  }
+  file->lines.push_back(record(0x01, 0, NULL, 0, lower));
+}
+
+/**
+ * 行をつないで1つのfileにする(改行はLF,CRLF,後ろの空白がばらばら)
+ */
+static std::string joinFile(const std::vector<std::string> &lines) {
+  static const char *const ends[] = {"\n", "\r\n", " \n", "\t\r\n"};
+  std::string text;
+  for (size_t i = 0; i < lines.size(); i++) {
+    text += lines[i];
+    if ((i + 1 < lines.size()) || (randomInt(2) == 0)) {
+      text += ends[randomInt(4)];
+    }
+  }
+  return text;
+}
+
+/**
+ * 1行の1byte(ascii 2文字)を書き換え、checksumを合わせ直す
+ */
+static void patchByte(std::string *line, int index, uint8_t data) {
+  static const char digits[] = "0123456789ABCDEF";
+  (*line)[1 + index * 2] = digits[data >> 4];
+  (*line)[2 + index * 2] = digits[data & 0x0f];
+  int count = (line->size() - 1) / 2;
+  uint8_t sum = 0;
+  for (int i = 0; i < count - 1; i++) {
+    sum += refByte(&(*line)[1 + i * 2]);
+  }
+  uint8_t check = -sum;
+  (*line)[1 + (count - 1) * 2] = digits[check >> 4];
+  (*line)[2 + (count - 1) * 2] = digits[check & 0x0f];
+}
+
+//=====================================
+// 試験
+//=====================================
+static int failed = 0;
+
+static void check(const char *name, bool ok) {
+  printf("%-36s %s\n", name, ok ? "OK" : "NG");
+  if (!ok) {
+    failed++;
+  }
+}
+
+/**
+ * 参照用の解析と一致するか
+ *
+ * @param[in] int expect: 期待するエラー(1:確認しない)
+ * @return true:一致して、期待したエラーになった
+ */
+static bool compareParse(const std::string &text, int expect) {
+  parseResult_t ref;
+  parseResult_t now;
+  parseFile(text, refParseLine, &ref);
+  parseFile(text, newParseLine, &now);
+  if (!sameResult(ref, now)) {
+    fprintf(stderr, "mismatch: ref %s, new %s\n%s\n", hexErrorText(ref.ans),
+            hexErrorText(now.ans), text.c_str());
+    return false;
+  }
+  if ((expect != 1) && (now.ans != expect)) {
+    fprintf(stderr, "expect %s, got %s\n%s\n", hexErrorText(expect),
+            hexErrorText(now.ans), text.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+ * address空間の最後付近の拡張addressとdata record
+ *
+ * base + address + byte数がuint32_tで一巡して256未満になる組み合わせも
+ * 範囲外として受け付けない
+ */
+static bool checkBase(void) {
+  static const struct {
+    int type;    //<! 拡張addressのrecord type
+    int base;    //<! 拡張addressの値
+    int address; //<! data recordのaddress
+    int count;   //<! data recordのbyte数
+  } cases[] = {
+      {0x04, 0xffff, 0xfff0, 16}, // 0xfffffff0 + 16 = 0
+      {0x04, 0xffff, 0xffff, 1},  // 0xffffffff + 1 = 0
+      {0x02, 0xffff, 0xfff0, 16}, // 0xffff0 + 0xfff0
+      {0x02, 0xffff, 0x0000, 16}, // 0xffff0 + 16 = 0x100000
+      {0x02, 0x0001, 0x0000, 16}, // 0x10: 256byte以内でもbaseは0のみ
+  };
+  uint8_t data[16];
+  memset(data, 0x5a, sizeof(data));
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    uint8_t value[2] = {(uint8_t)(cases[i].base >> 8), (uint8_t)cases[i].base};
+    std::vector<std::string> lines;
+    lines.push_back(record(cases[i].type, 0, value, 2, false));
+    lines.push_back(
+        record(0x00, cases[i].address, data, cases[i].count, false));
+    lines.push_back(record(0x01, 0, NULL, 0, false));
+    if (!compareParse(joinFile(lines), HEX_ERR_RANGE)) {
+      return false;
+    }
+  }
+  // 256byteの最後までは受け付ける
+  std::vector<std::string> lines;
+  lines.push_back(record(0x00, 0xf0, data, 16, false));
+  lines.push_back(record(0x01, 0, NULL, 0, false));
+  return compareParse(joinFile(lines), HEX_OK);
+}
+
+/**
+ * 全ての2文字の組み合わせでatoh2()と同じ変換になるか
+ */
+static bool checkDigits(void) {
+  for (int a = 1; a < 256; a++) {
+    for (int b = 1; b < 256; b++) {
+      char text[3] = {(char)a, (char)b, 0};
+      uint8_t data = 0;
+      int ans = hexDecode(text, &data, 1);
+      int ref = refByte(text);
+      if ((ans < 0) != (ref < 0)) {
+        return false;
+      }
+      if ((ref >= 0) && ((data != atoh2(text)) || (ans != ref))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * 正常なHEX fileを読み込めるか
+ */
+static bool checkValid(int count) {
+  hexFile_t file;
+  for (int n = 0; n < count; n++) {
+    makeFile(&file);
+    std::string text = joinFile(file.lines);
+    if (!compareParse(text, HEX_OK)) {
+      return false;
+    }
+    if ((memcmp(hexData, file.image, 256) != 0)) {
+      fprintf(stderr, "data mismatch\n%s\n", text.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * hexFormat()で作ったHEX fileを読み込めるか
+ */
+static bool checkFormat(int count) {
+  uint8_t image[16][16];
+  char text[Z_hexFileSize + 1];
+  for (int n = 0; n < count; n++) {
+    for (int i = 0; i < 256; i++) {
+      image[i >> 4][i & 0x0f] = random32();
+    }
+    if ((hexFormat(image, text) != Z_hexFileSize) ||
+        (strlen(text) != Z_hexFileSize) || !compareParse(text, HEX_OK) ||
+        (memcmp(hexData, image, 256) != 0)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * GreenPAK DesignerのHEX fileと同じ文字列になるか
+ */
+static bool checkDesigner(void) {
+  FILE *fp = localOpen("NVM.hex", "rb");
+  if (fp == NULL) {
+    return false;
+  }
+  char file[Z_hexFileSize + 2];
+  int size = fread(file, 1, sizeof(file) - 1, fp);
+  fclose(fp);
+  file[size] = '\0';
+
+  parseResult_t result;
+  parseFile(file, newParseLine, &result);
+  char text[Z_hexFileSize + 1];
+  return (result.ans == HEX_OK) && (hexFormat(result.data, text) == size) &&
+         (strcmp(file, text) == 0);
+}
+
+/**
+ * 壊したHEX fileの確認
+ *
+ * 異常の種類ごとに期待するエラーになるか確認する
+ * (どのエラーになるか決まらない壊し方は、参照用と一致することだけ確認する)
+ */
+static bool checkBroken(int count, int kind) {
+  hexFile_t file;
+  for (int n = 0; n < count; n++) {
+    makeFile(&file);
+    std::vector<std::string> &lines = file.lines;
+    // end of file以外のrecordを1つ選ぶ
+    int index;
+    do {
+      index = randomInt(lines.size() - 1);
+    } while (lines[index].empty());
+    std::string &line = lines[index];
+    int chars = line.size();
+    int expect = 1;
+
+    switch (kind) {
+    case 0: // 1文字を任意の文字に置き換える
+      line[randomInt(chars)] = 1 + randomInt(255);
+      break;
+    case 1: // 1文字削除
+      line.erase(randomInt(chars), 1);
+      break;
+    case 2: // 1文字追加
+      line.insert(randomInt(chars + 1), 1, (char)(1 + randomInt(255)));
+      break;
+    case 3: { // checksumだけを別のhex文字にする
+      char &c = line[chars - 1 - randomInt(2)];
+      c = "0123456789ABCDEF"[(atoh1(&c) + 1 + randomInt(15)) & 0x0f];
+      expect = HEX_ERR_CHECKSUM;
+    } break;
+    case 4: // dataにhex以外の文字
+      line[9 + randomInt(chars - 11)] = "GgZz:-+ x"[randomInt(9)];
+      expect = HEX_ERR_FORMAT;
+      break;
+    case 5: // byte数がrecordの長さと合わない
+      patchByte(&line, 0, (uint8_t)(refByte(&line[1]) + 1 + randomInt(255)));
+      expect = HEX_ERR_LENGTH;
+      break;
+    case 6: // 0x00～0xffの範囲外のaddress
+      if (refByte(&line[7]) != 0x00) {
+        n--; // data record以外は選び直す
+        continue;
+      }
+      patchByte(&line, 1, 1 + randomInt(255));
+      expect = HEX_ERR_RANGE;
+      break;
+    case 7: { // 他のrecordと重なるaddress
+      if (refByte(&line[7]) != 0x00) {
+        n--;
+        continue;
+      }
+      int size = refByte(&line[1]);
+      int address = refByte(&line[5]);
+      int other = randomInt(256 - size + 1);
+      if (other == address) {
+        other = (address + 1 <= 256 - size) ? address + 1 : address - 1;
+      }
+      if (other < 0) {
+        n--; // 256byteのrecordは重ならないaddressに移せない
+        continue;
+      }
+      patchByte(&line, 2, other);
+      expect = HEX_ERR_OVERLAP;
+    } break;
+    case 8: // 未対応のrecord type
+      patchByte(&line, 3, 0x06 + randomInt(250));
+      expect = HEX_ERR_TYPE;
+      break;
+    case 9: // end of fileの後のrecord
+      lines.push_back(lines[index]);
+      expect = HEX_ERR_AFTER_EOF;
+      break;
+    case 10: // end of fileなし
+      lines.pop_back();
+      expect = HEX_ERR_NO_EOF;
+      break;
+    case 11: // 行頭が':'でない
+      line[0] = "; 0"[randomInt(3)];
+      expect = HEX_ERR_FORMAT;
+      break;
+    case 12: { // data recordの前に0以外の拡張address(半分はaddress空間の最後付近)
+      if (refByte(&line[7]) != 0x00) {
+        n--;
+        continue;
+      }
+      int base = randomInt(2) ? 0xffff - randomInt(16) : 1 + randomInt(0xffff);
+      uint8_t value[2] = {(uint8_t)(base >> 8), (uint8_t)base};
+      lines.insert(lines.begin() + index,
+                   record(randomInt(2) ? 0x02 : 0x04, 0, value, 2, false));
+      expect = HEX_ERR_RANGE;
+    } break;
+    default: { // recordに入りきらない長い行(後ろの方にhex以外の文字があっても同じ)
+      int size = 2 * (300 + randomInt(100));
+      for (int i = 0; i < size; i++) {
+        line += "0123456789ABCDEF"[randomInt(16)];
+      }
+      if (randomInt(2) == 0) {
+        line[line.size() - 1 - randomInt(16)] = 'x';
+      }
+      expect = HEX_ERR_LENGTH;
+    } break;
+    }
+    if (!compareParse(joinFile(lines), expect)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//=====================================
+// benchmark
+//=====================================
+/**
+ * 解析速度の測定
+ *
+ * count record分のHEX fileを解析し、1秒あたりのrecord数を返す
+ * (256byteごとにhexParseBegin()からやり直す)
+ */
+static double benchParse(std::vector<char> &text, parseLine_t parseLine,
+                         int *records) {
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  hexParser_t hp;
+  int ans = HEX_OK;
+  *records = 0;
+  char *line = &text[0];
+  hexParseBegin(&hp);
+  while ((ans == HEX_OK) && (*line != '\0')) {
+    char *next = strchr(line, '\n');
+    *next++ = '\0';
+    ans = parseLine(&hp, line);
+    next[-1] = '\n'; // 次の測定でも同じ入力を使う
+    line = next;
+    if (hp.eof) {
+      *records += hp.records;
+      hexParseBegin(&hp);
+    }
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count();
+  if (ans != HEX_OK) {
+    *records = -1;
+  }
+  return *records / sec;
+}
+
+static void bench(int count, int size) {
+  std::vector<std::string> lines;
+  uint8_t data[256];
+  int records = 0;
+  while (records < count) {
+    for (int address = 0; (address < 256) && (records < count);
+         address += size, records++) {
+      for (int i = 0; i < size; i++) {
+        data[i] = random32();
+      }
+      lines.push_back(record(0x00, address, data, size, false));
+    }
+    lines.push_back(record(0x01, 0, NULL, 0, false));
+  }
+  std::vector<char> text;
+  for (size_t i = 0; i < lines.size(); i++) {
+    text.insert(text.end(), lines[i].begin(), lines[i].end());
+    text.push_back('\n');
+  }
+  text.push_back('\0');
+
+  int refRecords;
+  int newRecords;
+  double ref = benchParse(text, refParseLine, &refRecords);
+  double now = benchParse(text, newParseLine, &newRecords);
+  printf("%3d byte/record %8d records %5.1f MB: atoh1 %10.0f rec/s, "
+         "table %10.0f rec/s (x%.2f)\n",
+         size, records, text.size() / 1e6, ref, now, now / ref);
+  check("benchmark records", (refRecords == count) && (newRecords == count));
+}
+
+int main(int argc, char **argv) {
+  int count = 20000;
+  int records = 200000;
+  localDir = "../greenPakSample/";
+
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+      count = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc)) {
+      randomState = strtoul(argv[++i], NULL, 0);
+      if (randomState == 0) {
+        randomState = 1;
+      }
+    } else if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc)) {
+      records = atoi(argv[++i]);
+    } else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+      localDir = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-n count] [-s seed] [-b records] [-d dir]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  static const char *const broken[] = {
+      "broken: replace char", "broken: delete char", "broken: insert char",
+      "broken: checksum",     "broken: non hex char", "broken: byte count",
+      "broken: address range", "broken: address overlap",
+      "broken: record type",  "broken: after eof",   "broken: no eof",
+      "broken: no start code", "broken: base address", "broken: long line"};
+
+  check("digits (atoh2)", checkDigits());
+  check("valid files", checkValid(count));
+  for (int i = 0; i < (int)(sizeof(broken) / sizeof(broken[0])); i++) {
+    check(broken[i], checkBroken(count / 4, i));
+  }
+  check("base address near 0xffff", checkBase());
+  check("format round trip", checkFormat(count / 4));
+  check("format = GreenPAK Designer", checkDesigner());
+  if (records > 0) {
+    bench(records, 16);
+    bench(records, 64);
+  }
+  return (failed == 0) ? 0 : 1;
+}
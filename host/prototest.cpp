@@ -0,0 +1,228 @@
+/**
+ * binary通信(GreenPakProtocol.h)のloopback試験 (PC上で実行)
+ *
+ * serial portの代わりにbyte列のqueueでGpClientとprotoPoll()をつなぎ、
+ * Slg46826Simに対して転送,書き込み,確認,読み出しを行う。
+ * HEX fileは最初に読み込むだけで、書き込みはRAM上のimage(転送したデータ)で行う
+ *
+ * usage: prototest [-v] [-d dir]
+ *   -v : mbed側の処理の表示を出力する
+ *   -d : HEX fileのディレクトリ(初期値 ../greenPakSample/)
+ *
+ * @file
+ */
+#include "GpClient.h"
+#include "GreenPak.h"
+#include "GreenPakProtocol.h"
+#include "HostConsole.h"
+#include "Slg46826Sim.h"
+#include <deque>
+#include <string.h>
+
+//=====================================
+// 接続先
+//=====================================
+SimBus simBus;
+HostConsole hostConsole;
+GreenPakBus &Wire = simBus;
+GreenPakConsole &pc = hostConsole;
+
+static Slg46826Sim device(0x00);
+
+/**
+ * serial portの代わりのqueue
+ *
+ * PC側で受信データがない時は、mbed側の処理(protoPoll())を進める
+ */
+class LoopbackLink : public GreenPakLink {
+public:
+  LoopbackLink(std::deque<uint8_t> &rx, std::deque<uint8_t> &tx,
+               void (*pump)(void) = NULL)
+      : _rx(rx), _tx(tx), _pump(pump) {}
+
+  virtual int readable(void) {
+    if (_rx.empty() && (_pump != NULL)) {
+      _pump();
+    }
+    return !_rx.empty();
+  }
+  virtual int getc(void) {
+    uint8_t data = _rx.front();
+    _rx.pop_front();
+    return data;
+  }
+  virtual void write(const char *data, int length) {
+    _tx.insert(_tx.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+  }
+
+private:
+  std::deque<uint8_t> &_rx;
+  std::deque<uint8_t> &_tx;
+  void (*_pump)(void);
+};
+
+static std::deque<uint8_t> toDevice;
+static std::deque<uint8_t> toHost;
+static LoopbackLink deviceLink(toDevice, toHost);
+static bool deviceEnd = false;
+
+static void devicePump(void) {
+  if (protoPoll(deviceLink) != 0) {
+    deviceEnd = true;
+  }
+}
+
+static LoopbackLink hostLink(toHost, toDevice, devicePump);
+
+//=====================================
+// 試験
+//=====================================
+static int failed = 0;
+
+static void check(const char *name, bool ok) {
+  printf("%-28s %s\n", name, ok ? "OK" : "NG");
+  if (!ok) {
+    failed++;
+  }
+}
+
+/**
+ * 書き込み結果の確認(NVMの0xCAはslave addressなので比較しない)
+ */
+static bool same(const uint8_t *memory, const uint8_t image[16][16],
+                 bool nvm) {
+  for (int i = 0; i < 256; i++) {
+    if (nvm && (i == 0xCA)) {
+      continue;
+    }
+    if (memory[i] != image[i >> 4][i & 0x0f]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  localDir = "../greenPakSample/";
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      hostConsole.enable = true;
+    } else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+      localDir = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-v] [-d dir]\n", argv[0]);
+      return 2;
+    }
+  }
+  simBus.attach(&device);
+
+  uint8_t nvmImage[16][16];
+  uint8_t eepromImage[16][16];
+  if (imageRead(NVM) != 256) {
+    fprintf(stderr, "%s: image read error\n", localDir);
+    return 1;
+  }
+  memcpy(nvmImage, hexData, 256);
+  if (imageRead(EEPROM) != 256) {
+    fprintf(stderr, "%s: image read error\n", localDir);
+    return 1;
+  }
+  memcpy(eepromImage, hexData, 256);
+
+  // 以後はPCから転送したimageだけで書き込む
+  localDir = "/nonexistent/";
+  hexCacheFlush();
+  pc.level = CONSOLE_OFF;
+
+  GpClient client(hostLink);
+  GpClient::response_t response;
+  protoBegin();
+
+  check("status", client.status(&response) == PROTO_OK);
+  check("upload NVM", client.upload(NVM, nvmImage) == PROTO_OK);
+  check("upload EEPROM", client.upload(EEPROM, eepromImage) == PROTO_OK);
+  check("status ram image",
+        (client.status(&response) == PROTO_OK) && (response.payload[7] == 3));
+
+  // 応答を待たずに書き込み,確認を続けて送る
+  uint8_t nvm[1] = {NVM};
+  uint8_t eeprom[1] = {EEPROM};
+  uint8_t writeNvm[3] = {NVM, 0xff, 0};
+  uint8_t writeEeprom[3] = {EEPROM, 0xff, 0};
+  client.send(PROTO_WRITE, writeNvm, sizeof(writeNvm));
+  client.send(PROTO_VERIFY, nvm, sizeof(nvm));
+  client.send(PROTO_WRITE, writeEeprom, sizeof(writeEeprom));
+  client.send(PROTO_VERIFY, eeprom, sizeof(eeprom));
+  check("pipelined write/verify", client.flush() == PROTO_OK);
+  check("NVM contents", same(device.nvm, nvmImage, true));
+  check("EEPROM contents", same(device.eeprom, eepromImage, false));
+
+  int mismatches = -1;
+  check("verify NVM", (client.verify(NVM, &mismatches) == PROTO_OK) &&
+                          (mismatches == 0));
+
+  uint8_t data[16][16];
+  check("read NVM", (client.read(NVM, data) == PROTO_OK) &&
+                        (memcmp(data, device.nvm, 256) == 0));
+
+  // CRCの壊れたframeにはPROTO_NAKを返し、次のframeは処理できる
+  uint8_t frame[Z_protoFrame];
+  int size = protoEncode(frame, 0x55, PROTO_STATUS, NULL, 0);
+  frame[3] ^= 0x01;
+  hostLink.write((const char *)frame, size);
+  devicePump();
+  protoParser_t parser;
+  protoParseBegin(&parser);
+  int ans = 0;
+  while ((ans == 0) && !toHost.empty()) {
+    ans = protoParse(&parser, hostLink.getc());
+  }
+  check("crc error -> nak", (ans == 1) && (protoSeq(&parser) == 0x55) &&
+                                (protoCommand(&parser) ==
+                                 (PROTO_NAK | PROTO_RESPONSE)) &&
+                                ((int8_t)protoPayload(&parser)[0] ==
+                                 PROTO_ERR_CRC));
+
+  // frameの前の雑音(textの表示など)は読み捨てる
+  const char noise[] = "\n>\xA5\x11";
+  hostLink.write(noise, sizeof(noise) - 1);
+  check("resync after noise", client.status(&response) == PROTO_OK);
+
+  client.send(0x33, NULL, 0);
+  check("unknown command", (client.receive(&response) == 0) &&
+                               ((int8_t)response.payload[0] ==
+                                PROTO_ERR_COMMAND));
+
+  uint8_t badUpload[2 + 8] = {NVM, 0x08};
+  client.send(PROTO_UPLOAD, badUpload, sizeof(badUpload));
+  check("unaligned upload", (client.receive(&response) == 0) &&
+                                ((int8_t)response.payload[0] ==
+                                 PROTO_ERR_COMMAND));
+
+  // 転送途中(offset 0の1回分だけ)のimageでは書き込まない(/localのfileを使わない)
+  uint8_t partUpload[2 + 16] = {NVM, 0x00};
+  client.send(PROTO_UPLOAD, partUpload, sizeof(partUpload));
+  client.send(PROTO_WRITE, writeNvm, sizeof(writeNvm));
+  uint32_t writes = device.writes;
+  check("write partial upload",
+        (client.receive(&response) == 0) &&
+            ((int8_t)response.payload[0] == PROTO_OK) &&
+            (client.receive(&response) == 0) &&
+            ((int8_t)response.payload[0] == PROTO_ERR_UPLOAD) &&
+            (device.writes == writes));
+
+  check("end", (client.end() == PROTO_OK) && deviceEnd);
+
+  // 正常なframeがZ_protoIdleUsの間なければ、PROTO_ENDなしで終了する
+  protoBegin();
+  hostLink.write(noise, sizeof(noise) - 1);
+  Wire.wait_us(Z_protoIdleUs / 2);
+  int idle = protoPoll(deviceLink);
+  Wire.wait_us(Z_protoIdleUs / 2 + 1);
+  check("idle timeout", (idle == 0) && (protoPoll(deviceLink) == -1));
+
+  printf("%u frames, %u naks, I2C %.3f ms (simulated)\n", client.sent,
+         client.naks, simBus.nowUs() / 1000.0);
+  return (failed == 0) ? 0 : 1;
+}
@@ -21,13 +21,16 @@
  * p10(scl) - 8Pin(scl)
  * VOUT(3.3V) - 1Pin,14Pin
  * GND        - 11Pin
- * mbedにはGreenPakを1つだけ接続できる（GreenPakの複数接続には未対応)
+ * mbedにはGreenPakを1つだけ接続できる
+ * (一括書き込み(gn,ge,gr)だけはControl Codeの異なる複数のGreenPakを接続できる)
  *
  * ●書き込み用HEX fileの準備
  * GreenPakのHEX fileの名称を以下のようにする(これ以外の名称は無視される)
  * NVM,RESISTER : NVM.hex
  * EEPROM       : EEPROM.hex
  * このhex fileをmbedのルートディレクトリに転送しておく
+ * HEX fileをhost/hex2gpbで変換したbinary image file(NVM.gpb,EEPROM.gpb)があれば
+ * そちらを優先して使う(HEX fileの解析が不要になる)
  *
  * ●command
  * データ読み出し
@@ -35,18 +38,134 @@
  *   re: EEPROM領域のデータ読み出し
  *   rr: RESISTER領域のデータ読み出し
  *
+ * データ保存(読み出した内容をmbedのUSBドライブにHEX fileとして保存する.
+ * そのまま書き込み用のNVM.hex,EEPROM.hexやGreenPAK Designerで使える)
+ *   dn: NVM領域を RD_NVM.hex に保存
+ *   de: EEPROM領域を RD_EEP.hex に保存
+ *   dr: RESISTER領域を RD_REG.hex に保存
+ *
  * データ書き込み
  *   wnx: NVM領域へのNVM.hexの書き込み. xにはslave address=0～f
  * を設定(設定しない場合は、現状のslave addressを継承) we:
  * EEPROM領域へのEEPROM.hexの書き込み wr: RESISTER領域へのNVM.hexの書き込み
+ *   (pageごとのクリア,書き込みがNACK,ACK確認の失敗になると、待ち時間を倍にしながら
+ *    そのpageだけをやり直す. 回数,待ち時間はar,abで設定する)
+ *   wc: 途中で失敗した書き込み(wn,we,wr,un,ue,ur)を失敗したpageから続ける
+ *   ws: 直前の書き込みのpageごとのretry回数と、続きの有無を表示
+ *
+ * 一括書き込み(接続されている全てのGreenPakに書き込む)
+ *   gn: NVM領域へのNVM.hexの書き込み. slave addressはそれぞれ現状のaddressを継承
+ *   ge: EEPROM領域へのEEPROM.hexの書き込み
+ *   gr: RESISTER領域へのNVM.hexの書き込み
+ *
+ * 複製(複製元GreenPakの内容をRAMに読み込み、file,HEX変換なしで書き込む.
+ * 他のControl CodeのGreenPakが接続されていれば全てに書き込む. 接続されていなければ
+ * 差し替えたGreenPakにwn,we,m,meで書き込む. RAMの内容はhfで破棄する)
+ *   cnx: NVM領域の複製. xは複製元のslave address=0～f(省略時は操作対象のGreenPak)
+ *   cex: EEPROM領域の複製
  *
- * クリア
+ * 差分書き込み(GreenPakの内容と比較して、変わったpageだけをクリア,書き込みする)
+ *   unx: NVM領域へのNVM.hexの差分書き込み. xはwnxと同じ
+ *   ue: EEPROM領域へのEEPROM.hexの差分書き込み
+ *   ur: RESISTER領域へのNVM.hexの差分書き込み
+ *
+ * 書き込み内容の確認(NVM.hex,EEPROM.hexと比較して結果と不一致addressを表示)
+ *   vn: NVM領域の確認
+ *   ve: EEPROM領域の確認
+ *   vr: RESISTER領域の確認(0x00～0xBF)
+ *   vax: x=1:書き込み後に自動で確認する, x=0:確認しない
+ *
+ * クリア(既にクリアされているpageはクリアしない)
  *   en: NVM領域のクリア
  *   ee: EEPROM領域のクリア
  *
+ * ブランクチェック(pageごとにクリアされているかを表示)
+ *   bn: NVM領域のブランクチェック
+ *   be: EEPROM領域のブランクチェック
+ *
  *  slave addressの確認
  *   p: 今現在有効になっているslave addressを表示
  *
+ *  型番(初期値 SLG46826. 型番を指定した.gpb(hex2gpb -d)を読み込むとその型番になる)
+ *   n: 選択中の型番と対応している型番の表示
+ *   nxx: 型番を選択する xx=24:SLG46824(EEPROMなし), 26:SLG46826, 27:SLG46827
+ *
+ *  書き込みデータのlibrary(製品ごとのHEX file,.gpbを解析済みでRAMに保存しておき、
+ *  fileの差し替え,解析なしで切り替える. 最大16個)
+ *   i: 一覧表示(*は選択中)
+ *   ilnx name: NVM用に/local/nameをslot x(0～f)に読み込む 例: iln3 nvm_a.hex
+ *   ilex name: EEPROM用に/local/nameをslot xに読み込む
+ *   isx: slot xを選択する(以後の書き込みで使う. hfで選択を解除する)
+ *   ipx: slot xを選択して書き込む
+ *
+ *  HEX file読み込み
+ *   (NVM.hex,EEPROM.hexの内容が前回と同じであれば解析済みの内容を使う)
+ *   h: 解析済みHEX fileの状態表示
+ *   hf: 解析済みHEX file,PCから受け取ったimageを破棄する(次の書き込みで必ず解析する)
+ *   hvx: x=1:読み込み時にrecordの内容を表示する, x=0:表示しない
+ *
+ *  I2C clock
+ *   (GreenPakを最初に見つけた時に400kHz,100kHz,10kHzの順に読み出しを試し、
+ *    正しく読み出せた最速のclockを使う. 書き込みのNACK,確認の読み直しで内容が変われば
+ *    1段階遅くしてやり直す. ACK待ちの時間切れ,GreenPakの内容の違いでは遅くしない)
+ *   f: 使用中のclockと読み出し速度[byte/s]の表示
+ *   fxxx: clockをxxx[kHz](10進数, 10～400)に固定する
+ *   fa: clockの固定を解除し、選び直す
+ *
+ *  command script(入力待ちなしで続けて実行し、失敗したcommandで止める.
+ *  最後にcommandごとの結果と時間を表示する)
+ *   xx;yy;zz: ;で区切った複数のcommandを実行する 例: en;wn;vn;rn
+ *   s: /local/SCRIPT.txtのcommandを実行する(1行に1つまたは;区切り, #以降はcomment)
+ *
+ *  量産モード(GreenPakの差し込みを待って書き込み,確認し、取り外しを待つのを繰り返す.
+ *  LED1:書き込み中 LED2:正常終了 LED4:異常終了. enterで終了)
+ *   m: NVMに書き込む
+ *   me: NVMとEEPROMに書き込む
+ *   ms: 集計(個数,歩留まり,1時間あたりの個数,1個の処理時間 最小/平均/最大)の表示
+ *   mc: 集計のクリア
+ *
+ *  バックグラウンド処理(処理中もcommandを入力できる. I2Cを使うcommandは終了まで受け付けない)
+ *   jen,jee: NVM,EEPROMのクリア
+ *   jwn,jwe,jwr: NVM,EEPROM,RESISTERへの書き込み(slave addressは.gpbの指定または現状を継承)
+ *   jrn,jre,jrr: NVM,EEPROM,RESISTERの読み出し
+ *   j: 進捗の表示
+ *   k: 中断(GreenPakが処理中のpageの終了を待ってから止める)
+ *
+ *  処理時間(HEX file解析,protect解除,page毎のクリア,書き込み,ACK確認,再起動など)
+ *   t: 直前のcommandの処理時間と、処理ごとの集計(回数,最小/平均/最大,分布)を表示
+ *   tv: tと同じ内容をCSV形式で表示
+ *   tc: 集計をクリアする
+ *
+ *  binary通信
+ *   x: PCのhost/gpclientとのbinary通信を開始する(gpclientが終了を指示するまで.
+ *      正常なframeが10秒間なければtextのcommandに戻る)
+ *      書き込みデータの転送,書き込み,確認,読み出しをframe単位で行う(GreenPakProtocol.h)
+ *
+ *  表示
+ *   (表示はバッファに入れてから送信するので、書き込み処理は表示を待たない)
+ *   l: 表示の詳しさとバッファが一杯になった回数の表示
+ *   lq: 進捗1行と結果,異常だけを表示
+ *   ln: 処理の経過を表示(初期値)
+ *   lv: page毎の書き込みデータ,ACK確認結果も表示
+ *
+ *  ACK polling, retry設定
+ *   a: ACK polling, retry設定値の表示
+ *   aixxx: ACK確認間隔を設定 xxx=間隔[us](10進数, 10～100000)
+ *   atxxx: ACK待ちの制限時間を設定 xxx=制限時間[ms](10進数, 50～10000)
+ *   arx: pageごとのretry回数を設定 x=回数(10進数, 0～8)
+ *   abxxx: 1回目のretry前の待ち時間を設定 xxx=待ち時間[us](10進数, 0～100000,
+ *          retryごとに倍)
+ *   (範囲外の値は設定せず、設定値を表示する)
+ *
+ *  処理後の待ち時間(page erase,page writeのACK後, page write送信後, クリア後,
+ *  pingのaddressごと. 起動時に/local/SETTLE.txtがあれば読み込む)
+ *   o: 待ち時間(測定値, marginを加えて使う値, 初期値)の表示
+ *   oc, oce: EEPROM.hexの書き込み,確認を繰り返して最短の待ち時間を測り、
+ *        その2倍の値をSETTLE.txtに保存する(約40回書き換える)
+ *   ocn!: NVM.hexで測る(NVMは書き換え回数に制限があるので、!がなければ行わない)
+ *   omxxx: 測定値に加える余裕を設定して保存する xxx=余裕[%](10進数)
+ *   od: 初期値(以前の固定の待ち時間)に戻して保存する
+ *
  * <mbedの開発環境>
  * 使用ボード: LPC1768
  * 開発環境: Keil Studio Cloud
@@ -99,35 +218,124 @@ start code
 #include "mbed.h"
 #include <cstdint>
 #include <stdio.h>
-//#include <string.h>
+#include <stdlib.h>
+#include <string.h>
 #include "BufferedSerial.h"
+#include "GreenPak.h"
+#include "GreenPakProtocol.h"
 
 //=====================================
 // mbed内部のfilesystem
 //=====================================
 LocalFileSystem local("local"); // local file systemの設定
-#define Z_bufferNumber                                                         \
-  (100) // HEX fileは1行44byteなのでこれ以上のbyte数があればよい(file
-        // systemは1行づつ読み込まれる)
-
-char buffer[Z_bufferNumber]; // 読みだしたデータの保管先
 
 //=====================================
 // PCからのコマンド入力用USB-Uart
 //=====================================
-BufferedSerial pc(USBTX, USBRX);
+BufferedSerial pcSerial(USBTX, USBRX, 512,
+                        1); // 受信512byte(binary通信の先送り分), 送信はSerialConsoleがUARTに直接書く
 #define PC_BOUD (115200)
 #define Z_pcBuffer (100) // PCからのコマンド保管用
 char B_pcRx[Z_pcBuffer] __attribute__((
     section("AHBSRAM0"))); // RAMが足りないのでEthernet用エリアを使用
                            // (0x2007c000)　(コピー元をそのまま転記した)
 
+#define Z_pcTxBuffer (2048) // PCへの表示待ちデータ保管用
+char B_pcTx[Z_pcTxBuffer] __attribute__((section("AHBSRAM0")));
+
+/**
+ * GreenPak処理からPCへの表示出力先(USB-Uart)
+ *
+ * 表示データはリングバッファに入れるだけで戻り、Tickerで少しずつ送信する
+ * (I2C処理が表示の終わりを待たない)
+ * バッファが一杯の時だけ空きができるまで送信してから戻る
+ * BufferedSerialの送信バッファは一杯になると未送信のデータを上書きするので使わず、
+ * UART(USBTX=UART0)の送信FIFOに直接書き込む
+ */
+#define Z_uartTxFifo (16) // LPC1768 UARTの送信FIFO段数
+#define Z_uartLsrThre (1 << 5) // LSR THRE: 送信FIFOが空
+
+class SerialConsole : public GreenPakConsole {
+public:
+  SerialConsole() : overflows(0), _head(0), _tail(0) {}
+
+  virtual void write(const char *data, int length) {
+    for (int i = 0; i < length; i++) {
+      int next = (_head + 1) % Z_pcTxBuffer;
+      if (next == _tail) {
+        overflows++;
+        while (next == _tail) {
+          // Tickerのdrain()と_tail,putc()を取り合わないように割り込みを止める
+          core_util_critical_section_enter();
+          drain();
+          core_util_critical_section_exit();
+        }
+      }
+      B_pcTx[_head] = data[i];
+      _head = next;
+    }
+  }
+
+  /**
+   * 送信FIFOが空なら、FIFOの段数分まで送信する(Tickerから呼び出す)
+   *
+   * FIFOに入りきる分しか書かないので、送信待ちのデータを上書きしない.
+   * Ticker以外から呼び出す場合は割り込みを止めておく
+   */
+  void drain(void) {
+    if ((LPC_UART0->LSR & Z_uartLsrThre) == 0) {
+      return;
+    }
+    for (int i = 0; (i < Z_uartTxFifo) && (_tail != _head); i++) {
+      LPC_UART0->THR = B_pcTx[_tail];
+      _tail = (_tail + 1) % Z_pcTxBuffer;
+    }
+  }
+
+  /// 送信待ちbyte数
+  int pending(void) const {
+    return (_head - _tail + Z_pcTxBuffer) % Z_pcTxBuffer;
+  }
+
+  uint32_t overflows; //<! バッファが一杯で送信を待った回数
+
+private:
+  volatile int _head; //<! 次に書き込む位置
+  volatile int _tail; //<! 次に送信する位置
+};
+
+SerialConsole serialConsole;
+GreenPakConsole &pc = serialConsole;
+Ticker pcTxTicker; //<! 表示データの送信用
+
+/**
+ * PCとのbinary通信路(USB-Uart)
+ *
+ * 送信はSerialConsoleのリングバッファを使う(表示の詳しさに関係なく送信する)
+ */
+class SerialLink : public GreenPakLink {
+public:
+  SerialLink(BufferedSerial &serial, SerialConsole &console)
+      : _serial(serial), _console(console) {}
+  virtual int readable(void) { return _serial.readable(); }
+  virtual int getc(void) { return _serial.getc(); }
+  virtual void write(const char *data, int length) {
+    _console.write(data, length);
+  }
+
+private:
+  BufferedSerial &_serial;
+  SerialConsole &_console;
+};
+
+SerialLink serialLink(pcSerial, serialConsole);
+
 //=====================================
-// mbedボード上の動作モニタLED (未使用)
+// mbedボード上の動作モニタLED (量産モードで使用)
 //=====================================
-// DigitalOut ledopen(LED1);
-// DigitalOut ledout(LED2);
-// DigitalOut lederror(LED4);
+DigitalOut ledopen(LED1);  //<! 書き込み中
+DigitalOut ledout(LED2);   //<! 書き込み,確認が正常終了
+DigitalOut lederror(LED4); //<! 書き込み,確認が異常終了
 
 //=====================================
 // GreenPak のI2C処理
@@ -135,50 +343,37 @@ char B_pcRx[Z_pcBuffer] __attribute__((
 /**
  * I2C定義(GreenPakとの通信用)
  */
-I2C Wire(p9, p10); //!< sda:p9, sci:p10
-
-/**
- * I2Cのslave address とGreenPakの"Control Byte"との関係
- *
- * I2Cのslave addressがGreenPakのControl byteに該当する
- * Control byteの構成
- * 上位4bit: Control Code :ICを特定するためのコード 0x0 ～ 0xf を選択できる
- *  このプログラムで"slave address"と言っているのは実際にはこのControl
- * Codeのことになる 下位4bit: Block Address :
- * IC内部のNVM,EEPROM,RESISTERを指示する(最下位の1bitはI2C通信のR/Wbitになる)
- * Block Address (Control Byte A10-8)
- *      A10
- *      |A9
- *      ||A8
- * xxxx 098xb
- * xxxx 001xb :resster
- * xxxx 010xb :NVM
- * xxxx 110xb :EEPROM
- * |  | |-| ←Block Address
- * |  |
- * |←→| ←Control Code
- */
+I2C i2c(p9, p10); //!< sda:p9, sci:p10
 
 /**
- * Block Address
+ * GreenPak処理からのI2C通信路(mbedのI2C)
+ *
+ * 時間はTimerで計る
  */
-#define RESISTER_CONFIG (0x02)
-#define NVM_CONFIG (0x04)
-#define EEPROM_CONFIG (0x06)
+class MbedBus : public GreenPakBus {
+public:
+  MbedBus(I2C &i2c) : _i2c(i2c) { _timer.start(); }
 
-#define MASK_CONTROLCODE                                                       \
-  (0xf0) //<! I2C slave address部の ControlCode(上位4bit)を残すためのマスク
+  virtual void frequency(int hz) { _i2c.frequency(hz); }
+  virtual int read(int address, char *data, int length, bool repeated) {
+    return _i2c.read(address, data, length, repeated);
+  }
+  virtual int write(int address, const char *data, int length,
+                    bool repeated) {
+    return _i2c.write(address, data, length, repeated);
+  }
+  virtual void stop(void) { _i2c.stop(); }
 
-uint8_t hexData[16][16] = {}; //<! hex fileから読みだしたデータの保管用
+  virtual void wait_us(uint32_t us) { ::wait_us(us); }
+  virtual uint32_t read_us(void) { return _timer.read_us(); }
 
-typedef enum {
-  NVM,
-  EEPROM,
-  RESISTER
-} greenPakMemory_t; //<! 操作対象メモリの指示用
+private:
+  I2C &_i2c;
+  Timer _timer;
+};
 
-char i2cBuffer
-    [17]; //<! I2C送受信用バッファ(GreenPakのaddress(1byte)+data(16byte)=17byte)
+MbedBus mbedBus(i2c);
+GreenPakBus &Wire = mbedBus;
 
 //=====================================
 // usb-serial
@@ -205,9 +400,9 @@ int pcRecive(void) {
   }
 
   // 1文字受信処理
-  while ((pc.readable() == 1) && ans == 0) {
+  while ((pcSerial.readable() == 1) && ans == 0) {
     // 受信データあり
-    data = pc.getc();
+    data = pcSerial.getc();
 
     switch (data) {
     case Z_CR:
@@ -233,570 +428,753 @@ int pcRecive(void) {
   return (ans);
 }
 
-/**
- * asciiコード1文字をhexに変換
- *
- * @param[in] char* p : 文字の入った変数のポインタ
- * @return 変換結果 0x00 ～ 0x0f, 0xff:変換不能
- */
-uint8_t atoh1(char *p) {
-  char a = *p;
-  uint8_t ans = 0xff;
-
-  if (('0' <= a) && (a <= '9')) {
-    ans = a - '0';
-  } else if (('a' <= a) && (a <= 'f')) {
-    ans = a - 'a' + 0x0a;
-  } else if (('A' <= a) && (a <= 'F')) {
-    ans = a - 'A' + 0x0a;
-  } else {
-    ans = 0xff;
-  }
-  return (ans);
-}
+//=====================================
+// command
+//=====================================
+int scriptRun(char *line);
+int productionRun(bool eeprom);
 
 /**
- *  asciiコード2文字をhexに変換
+ * commandの数値(10進数)の読み取り
  *
- * @param[in] char* p: 文字の入った変数ポインタ
- * @return 変換結果 0x00 ～ 0xff (変換不能の場合は0xffにしている)
+ * 数字以外が続く,範囲外(負,桁あふれを含む)の場合は受け付けない
+ * @param[out] long* value: 読み取った値
+ * @return true:min～maxの値 false:受け付けない(valueは変えない)
  */
-uint8_t atoh2(char *p) {
-  uint8_t ans;
-  uint8_t up = atoh1(p);
-  uint8_t dn = atoh1(p + 1);
-  if ((up != 0xff) && (dn != 0xff)) {
-    ans = (up << 4) | dn;
-  } else {
-    // 変換不能
-    ans = 0xff;
+static bool commandNumber(const char *p, long min, long max, long *value) {
+  char *end;
+  long number = strtol(p, &end, 10);
+  if ((end == p) || (*end != '\0') || (number < min) || (number > max)) {
+    pc.log(CONSOLE_QUIET, "range %ld-%ld\n", min, max);
+    return false;
   }
-  return (ans);
+  *value = number;
+  return true;
 }
 
 /**
- * HEX fileを読み出す
- *
- * 対象ファイルは"NVM.hex"か"EEPROM.hex"の決め打ち
- * hex fileの内容が意図しない形式になっていた場合のことは考慮していない
- * 異常データでも読み出しするので用意するHEX fileには注意すること
- * @param[in] 格納対象データ greenPakMemory_t NVM,RESISTER: NVM.hex, EEPROM:
- * EEPROM.hexを読み込む
- * @return 0:データなし n:読み込み桁数(正常なら16になる)
+ * 1つのcommandの実行
+ *
+ * @param[in] char* p: command(大文字, 空白なし)
+ * @return 0:正常終了 -1:異常終了 -2:commandの間違い
  */
-uint8_t hexFileRead(greenPakMemory_t memoryType) {
-  uint8_t ans = 0;
+int commandExecute(char *p) {
+  int ans = 0;
 
-  uint8_t byteCount;
-  uint8_t address; // 上位8bitは必ず0x00になるので省略
-  uint8_t recodeType;
+  // バックグラウンド処理中はI2Cを使わないcommandだけを受け付ける
+  if (jobBusy() && (*p != 'J') && (*p != 'K') && (*p != 'L') && (*p != 'T') &&
+      (*p != '\0')) {
+    pc.log(CONSOLE_QUIET, "busy (k: abort)\n");
+    return -1;
+  }
 
-  FILE *fp;
-  char *p;
+  switch (*p++) {
+  case '\0':
+    break;
+  case 'E':
+    pc.printf("erase start\n");
+    switch (*p++) {
+    case 'N':
+      ans = eraseChip(&session, NVM);
+      break;
+    case 'E':
+      ans = eraseChip(&session, EEPROM);
+      break;
+    case 'R':
+    default:
+      ans = -2;
+      break;
+    }
 
-  // 読みだしたデータの格納バッファを0x00に初期化する
-  // 0x00はNVM,EEPROM共に初期値なので安全側になる
-  for (uint8_t i; i < 16; i++) {
-    for (uint8_t j; j < 16; j++) {
-      hexData[i][j] = 0x00;
+    switch (ans) {
+    case 0:
+      pc.log(CONSOLE_QUIET, "erase OK\n");
+      break;
+    case -1:
+      pc.log(CONSOLE_QUIET, "erase NG\n");
+    case -2:
+    default:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    break;
+  case 'B':
+    switch (*p++) {
+    case 'N':
+      ans = blankCheck(&session, NVM);
+      break;
+    case 'E':
+      ans = blankCheck(&session, EEPROM);
+      break;
+    default:
+      ans = -2;
+      break;
     }
-  }
 
-  pc.printf("HEX file read\n");
+    switch (ans) {
+    case 0:
+      break;
+    case -1:
+      pc.log(CONSOLE_QUIET, "blank check NG\n");
+      break;
+    case -2:
+    default:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    break;
+  case 'V':
+    switch (*p++) {
+    case 'N':
+      ans = verifyChip(&session, NVM);
+      break;
+    case 'E':
+      ans = verifyChip(&session, EEPROM);
+      break;
+    case 'R':
+      ans = verifyChip(&session, RESISTER);
+      break;
+    case 'A':
+      autoVerify = (*p == '1');
+      pc.printf("auto verify = %d\n", autoVerify);
+      ans = 0;
+      break;
+    default:
+      ans = -2;
+      break;
+    }
 
-  switch (memoryType) {
-  case NVM:
-  case RESISTER:
-    fp = fopen("/local/NVM.hex", "r");
+    if (ans == -2) {
+      pc.log(CONSOLE_QUIET, "command error\n");
+    }
     break;
-  case EEPROM:
-    fp = fopen("/local/EEPROM.hex", "r");
+  case 'P':
+    ping();
     break;
-  default:
-    return 0;
+  case 'N':
+    // N27: SLG46827にする
+    if ((*p != '\0') && ((atoh2(p) == 0xff) || (p[2] != '\0') ||
+                         (deviceSelect(atoh2(p)) != 0))) {
+      ans = -2;
+      pc.log(CONSOLE_QUIET, "command error\n");
+    }
+    devicePrint();
     break;
-  }
-  if (fp == NULL) {
-    return 0;
-  }
-
-  while (fgets(buffer, Z_bufferNumber, fp) != NULL) {
-    p = buffer;
-
-    while (*p != 0x00) {
-      switch (*p++) {
-      case ':':
-        byteCount = atoh2(p);
-        p += 2;
-        p += 2;
-        address = atoh2(p) >> 4; // 2byte addressの下位1byteを取得
-        if (address > 0x0f) {
-          address = 0x00;
-        } // 範囲外なら0x00にしておく
-        p += 2;
-        recodeType = atoh2(p);
-        p += 2;
-
-        pc.printf("byte=%02x address=%02x type=%02x : ", byteCount, address,
-                  recodeType);
-        wait(.1);
-        if (byteCount != 0x10) {
-          pc.printf("end of data\n");
-          break;
-        }
-
-        ans++;
-        for (uint8_t i = 0; i < 16; i++) {
-          hexData[address][i] = atoh2(p);
-          p += 2;
-          pc.printf("%02x", hexData[address][i]);
-        }
-        pc.printf("\n");
-      }
+  case 'R':
+    pc.printf("Reading chip!\n");
+    switch (*p++) {
+    case 'N':
+      ans = readChip(&session, NVM);
+      break;
+    case 'E':
+      ans = readChip(&session, EEPROM);
+      break;
+    case 'R':
+      ans = readChip(&session, RESISTER);
+      break;
+    default:
+      ans = -2;
     }
-  }
-  fclose(fp);
-
-  return (ans);
-}
 
-//=====================================
-// GreenPak 操作
-//=====================================
-//*************************************
-/**
- * GreenPakのslave address(Control Code)を確認
- *
- * PCへのモニタ表示用
- */
-//*************************************
-void ping(void) {
-  int ans;
-  int control_code;
-
-  for (int i = 0; i < 16; i++) {
-    control_code = (i << 4) | RESISTER_CONFIG;
-    ans = Wire.read(control_code, i2cBuffer,
-                    0); // ICに影響を与えないようにreadコマンドで確認する
-    wait(0.01);
-    pc.printf("slave address =  0x%02x ", i);
-    if (ans == 0) {
-      pc.printf(" is present\n");
-    } else {
-      pc.printf(" is not present\n");
+    switch (ans) {
+    case 0:
+      pc.log(CONSOLE_QUIET, "read OK\n");
+      break;
+    case -1:
+      break;
+      pc.log(CONSOLE_QUIET, "read NG\n");
+    case -2:
+    default:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
     }
-  }
-  pc.printf("\n");
-  wait(0.1);
-}
-
-//*************************************
-/**
- * 接続されているGreenPakのslave addressを取得
- *
- * GreenPakの操作用
- * @return 取得したslave address: 0x00～0x0f, 見つからなければ0xffを返す
- */
-//*************************************
-int checkSlaveAddres(void) {
-  int control_code;
-  int address = 0xff;
-  int ans;
-
-  for (int i = 0; i < 16; i++) {
-    control_code = (i << 4) | RESISTER_CONFIG;
-
-    ans = Wire.read(control_code, i2cBuffer,
-                    0); // ICに影響を与えないようにreadコマンドで確認する
-    if (ans == 0) {
-      address = i;
-      //      pc.printf("slave address =  0x%02x\n", i);
+    break;
+  case 'W':
+    switch (*p++) {
+    case 'N':
+      ans = writeChip(&session, NVM, atoh1(p));
+      break;
+    case 'E':
+      ans = writeChip(&session, EEPROM);
+      break;
+    case 'R':
+      ans = writeChip(&session, RESISTER);
+      break;
+    case 'C':
+      ans = writeResume(&session);
+      break;
+    case 'S':
+      writeResumePrint();
+      return 0;
+    default:
+      ans = -2;
       break;
     }
-  }
-  return (address);
-}
 
-//*************************************
-/**
- * greenPak 再起動指示
- *
- * NVMの書き換えをしたときにNVMの内容をRESISTERに反映させるために再起動させる
- */
-//*************************************
-void powercycle(void) {
-  int slaveAddress = checkSlaveAddres();
-  if (slaveAddress == 0xff) {
-    return;
-  }
-
-  int control_code =
-      (slaveAddress << 4) | RESISTER_CONFIG; // ControlCode(A14-11)=slaveAddress(4bit)
-                                             // + BlockAddress(A10-8)=000b
-
-  pc.printf("Power Cycling!\n\n");
-  // Software reset
-  // レジスタアドレス=0xc8 bit1を1にすると I2C
-  // resetをしてNVMのデータをレジスタに転送することができる
-  i2cBuffer[0] = 0xC8;
-  i2cBuffer[1] = 0x02;
-  Wire.write(control_code, i2cBuffer,
-             2); // MASK_CONTROLCODEは Control Code:slave
-                 // addressを残しresisterアクセスにするためのマスク
-  // pc.printf("Done Power Cycling!\n");
-}
+    switch (ans) {
+    case 0:
+      pc.log(CONSOLE_QUIET, "write OK\n");
+      break;
+    case -1:
+      pc.log(CONSOLE_QUIET, "write NG\n");
+      break;
+    case -2:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    pc.printf("\n");
+    break;
+  case 'G':
+    switch (*p++) {
+    case 'N':
+      ans = gangWrite(NVM);
+      break;
+    case 'E':
+      ans = gangWrite(EEPROM);
+      break;
+    case 'R':
+      ans = gangWrite(RESISTER);
+      break;
+    default:
+      ans = -2;
+      break;
+    }
 
-//*************************************
-/**
- * GreenPakのAck確認
- *
- * GreenPakへの操作指示後の動作完了をI2CのACKの受信で確認する
- * @param[in] 確認対象のGreenPakのControl Byte
- * @return 0:ACK, -1:確認失敗
- */
-//*************************************
-int ackPolling(int addressForAckPolling) {
-  int ans;
-  int nack_count = 0;
-  while (1) {
+    switch (ans) {
+    case 0:
+      pc.log(CONSOLE_QUIET, "write OK\n");
+      break;
+    case -1:
+      pc.log(CONSOLE_QUIET, "write NG\n");
+      break;
+    case -2:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    pc.printf("\n");
+    break;
+  case 'U':
+    switch (*p++) {
+    case 'N':
+      ans = writeChip(&session, NVM, atoh1(p), true);
+      break;
+    case 'E':
+      ans = writeChip(&session, EEPROM, 0xff, true);
+      break;
+    case 'R':
+      ans = writeChip(&session, RESISTER, 0xff, true);
+      break;
+    default:
+      ans = -2;
+      break;
+    }
 
-    ans = Wire.read(addressForAckPolling, i2cBuffer, 0);
-    if (ans == 0) {
+    switch (ans) {
+    case 0:
+      pc.log(CONSOLE_QUIET, "write OK\n");
+      break;
+    case -1:
+      pc.log(CONSOLE_QUIET, "write NG\n");
+      break;
+    case -2:
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    pc.printf("\n");
+    break;
+  case 'D':
+    switch (*p++) {
+    case 'N':
+      ans = dumpChip(&session, NVM);
+      break;
+    case 'E':
+      ans = dumpChip(&session, EEPROM);
+      break;
+    case 'R':
+      ans = dumpChip(&session, RESISTER);
+      break;
+    default:
+      ans = -2;
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    break;
+  case 'H':
+    switch (*p++) {
+    case 'V':
+      hexVerbose = (*p == '1');
+      pc.printf("hex verbose = %d\n", hexVerbose);
+      break;
+    case 'F':
+      hexCacheFlush();
+      ramImageClear();
+      hexCachePrint();
+      break;
+    default:
+      hexCachePrint();
+      break;
+    }
+    break;
+  case 'F':
+    if (*p == 'A') {
+      busPin(0);
+      deviceInvalidate(&session);
+    } else if (*p != '\0') {
+      char *end;
+      long khz = strtol(p, &end, 10);
+      // 範囲外(0,負,桁あふれ)は固定しない. 上限を先に見て1000倍のあふれを防ぐ
+      if ((*end != '\0') || (khz <= 0) || (khz > busSpeedList[0] / 1000) ||
+          (busPin(khz * 1000) != 0)) {
+        pc.log(CONSOLE_QUIET, "command error\n");
+        ans = -2;
+        break;
+      }
+    }
+    ans = busSpeedReport(&session);
+    break;
+  case 'S':
+    ans = scriptRun(NULL);
+    break;
+  case 'J': {
+    jobType_t type = JOB_WRITE;
+    switch (*p++) {
+    case '\0':
+      jobPrint();
       return 0;
+    case 'E':
+      type = JOB_ERASE;
+      break;
+    case 'W':
+      type = JOB_WRITE;
+      break;
+    case 'R':
+      type = JOB_READ;
+      break;
+    default:
+      ans = -2;
+      break;
     }
-    if (nack_count >= 1000) {
-      pc.printf("Geez! Something went wrong while programming!\n");
-      return -1;
+    greenPakMemory_t memoryType = NVM;
+    switch (*p) {
+    case 'N':
+      memoryType = NVM;
+      break;
+    case 'E':
+      memoryType = EEPROM;
+      break;
+    case 'R':
+      memoryType = (type == JOB_ERASE) ? NVM : RESISTER;
+      ans = (type == JOB_ERASE) ? -2 : ans;
+      break;
+    default:
+      ans = -2;
+      break;
+    }
+    if (ans == -2) {
+      pc.log(CONSOLE_QUIET, "command error\n");
+    } else if (jobStart(type, &session, memoryType) != 0) {
+      pc.log(CONSOLE_QUIET, "busy\n");
+      ans = -1;
+    }
+  } break;
+  case 'K':
+    jobAbort();
+    jobPrint();
+    break;
+  case 'M':
+    switch (*p++) {
+    case '\0':
+      ans = productionRun(false);
+      break;
+    case 'E':
+      ans = productionRun(true);
+      break;
+    case 'S':
+      productionPrint();
+      break;
+    case 'C':
+      productionClear();
+      productionPrint();
+      break;
+    default:
+      ans = -2;
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
+    break;
+  case 'C':
+    switch (*p++) {
+    case 'N':
+      ans = cloneChip(NVM, atoh1(p));
+      break;
+    case 'E':
+      ans = cloneChip(EEPROM, atoh1(p));
+      break;
+    default:
+      ans = -2;
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
     }
-    nack_count++;
-    wait(1);
-  }
-}
-
-//*************************************
-/**
- * 操作対象のmemoryの表示
- *
- * PCに操作対象になっているmemoryの種別を表示する
- * @param[in] greenPakMemory_t 操作対象memory
- */
-//*************************************
-void printMemoryType(greenPakMemory_t memoryType) {
-  switch (memoryType) {
-  case NVM:
-    pc.printf("memory = NVM\n");
     break;
-  case EEPROM:
-    pc.printf("memory = EEPROM\n");
+  case 'I': {
+    uint8_t slot;
+    switch (*p++) {
+    case '\0':
+      libraryPrint();
+      break;
+    case 'L':
+      // ILN3NVM_A.HEX: NVM用にNVM_A.HEXをslot 3に読み込む
+      slot = atoh1(p + 1);
+      if (((*p != 'N') && (*p != 'E')) || (slot == 0xff) || (p[2] == '\0')) {
+        ans = -2;
+        break;
+      }
+      ans = libraryLoad(slot, (*p == 'E') ? EEPROM : NVM, p + 2);
+      if (ans == 0) {
+        libraryPrint();
+      }
+      ans = (ans == 0) ? 0 : -1;
+      break;
+    case 'S':
+      slot = atoh1(p);
+      ans = (slot == 0xff) ? -2 : librarySelect(slot);
+      break;
+    case 'P':
+      slot = atoh1(p);
+      ans = (slot == 0xff) ? -2 : libraryProgram(&session, slot);
+      if (ans != -2) {
+        pc.log(CONSOLE_QUIET, "write %s\n", (ans == 0) ? "OK" : "NG");
+      }
+      break;
+    default:
+      ans = -2;
+      break;
+    }
+    if (ans == -2) {
+      pc.log(CONSOLE_QUIET, "command error\n");
+    }
+  } break;
+  case 'T':
+    switch (*p) {
+    case '\0':
+      tracePrint(false);
+      break;
+    case 'V':
+      tracePrint(true);
+      break;
+    case 'C':
+      traceClear();
+      tracePrint(false);
+      break;
+    default:
+      ans = -2;
+      pc.log(CONSOLE_QUIET, "command error\n");
+      break;
+    }
     break;
-  case RESISTER:
-    pc.printf("memory = RESISTER\n");
+  case 'X': {
+    // binary通信 (PROTO_ENDを受け取るか、正常なframeが途切れるまで)
+    consoleLevel_t level = pc.level;
+    pc.level = CONSOLE_OFF;
+    int end;
+    protoBegin();
+    while ((end = protoPoll(serialLink)) == 0) {
+      hexCacheTick();
+    }
+    pc.level = level;
+    pc.printf((end < 0) ? "binary mode timeout\n" : "binary mode end\n");
+  } break;
+  case 'L':
+    switch (*p) {
+    case 'Q':
+      pc.level = CONSOLE_QUIET;
+      break;
+    case 'N':
+      pc.level = CONSOLE_NORMAL;
+      break;
+    case 'V':
+      pc.level = CONSOLE_VERBOSE;
+      break;
+    default:
+      break;
+    }
+    pc.log(CONSOLE_QUIET, "console level = %s, overflow = %lu\n",
+           (pc.level == CONSOLE_QUIET)
+               ? "quiet"
+               : ((pc.level == CONSOLE_NORMAL) ? "normal" : "verbose"),
+           (unsigned long)serialConsole.overflows);
+    break;
+  case 'A': {
+    // 範囲外の値は設定せず、今の設定値を表示する
+    long value;
+    switch (*p++) {
+    case '\0':
+      break;
+    case 'I':
+      if (commandNumber(p, Z_ackPollIntervalMinUs, Z_ackPollIntervalMaxUs,
+                        &value)) {
+        ackPollIntervalUs = value;
+      } else {
+        ans = -2;
+      }
+      break;
+    case 'T':
+      if (commandNumber(p, Z_ackPollTimeoutMinMs, Z_ackPollTimeoutMaxMs,
+                        &value)) {
+        ackPollTimeoutUs = value * 1000;
+      } else {
+        ans = -2;
+      }
+      break;
+    case 'R':
+      if (commandNumber(p, 0, Z_pageRetriesMax, &value)) {
+        pageRetries = value;
+      } else {
+        ans = -2;
+      }
+      break;
+    case 'B':
+      if (commandNumber(p, 0, Z_pageBackoffMaxUs, &value)) {
+        pageBackoffUs = value;
+      } else {
+        ans = -2;
+      }
+      break;
+    default:
+      ans = -2;
+      break;
+    }
+    if (ans == -2) {
+      pc.log(CONSOLE_QUIET, "command error\n");
+    }
+    pc.printf("ack polling interval = %luus, timeout = %lums\n",
+              (unsigned long)ackPollIntervalUs,
+              (unsigned long)(ackPollTimeoutUs / 1000));
+    pc.printf("page retry = %d, backoff = %luus (x2 each retry)\n",
+              pageRetries, (unsigned long)pageBackoffUs);
+  } break;
+  case 'O':
+    switch (*p++) {
+    case 'C':
+      // NVMは書き換え回数を使うので"ocn!"の場合だけ調整する
+      if ((*p != 'N') && (*p != 'E') && (*p != '\0')) {
+        ans = -2;
+        break;
+      }
+      ans = settleCalibrate(&session, (*p == 'N') ? NVM : EEPROM,
+                            (*p == 'N') && (p[1] == '!'));
+      if (ans == 0) {
+        ans = settleSave();
+      }
+      pc.log(CONSOLE_QUIET, "calibrate %s\n", (ans == 0) ? "OK" : "NG");
+      break;
+    case 'M':
+      settle.marginPct = strtoul(p, NULL, 10);
+      ans = settleSave();
+      settlePrint();
+      break;
+    case 'D':
+      settleDefault();
+      ans = settleSave();
+      settlePrint();
+      break;
+    default:
+      settlePrint();
+      break;
+    }
+    if (ans == -2) {
+      pc.log(CONSOLE_QUIET, "command error\n");
+    }
     break;
   default:
-    pc.printf("memory = unknown\n");
+    ans = -2;
+    pc.log(CONSOLE_QUIET, "command error\n");
     break;
   }
+  return ans;
 }
 
-//*************************************
+//=====================================
+// command script
+//=====================================
+#define Z_scriptSteps (32) //<! 結果を記録するcommand数
+
 /**
- * GreenPak NVMプロテクト解除
- *
- * NVM書き込み時に誤ってNVMプロテクトをかけてしまった場合に、それを解除する
+ * script中の1つのcommandの結果
  */
-//*************************************
-void resister_unprotect(void) {
-  int slaveAddress = checkSlaveAddres();
-  if (slaveAddress == 0xff) {
-    return;
-  }
+typedef struct {
+  char command[8]; //<! command(先頭7文字)
+  int result;      //<! commandExecute()の戻り値
+  uint32_t us;     //<! 処理時間[us]
+} scriptStep_t;
 
-  int control_code =
-      (slaveAddress << 4) |
-      RESISTER_CONFIG; // ControlCode(A14-11)=slaveAddress(4bit) +
-                       // BlockAddress(A10-8)=000b
-
-  // resisiterのプロテクトをクリアする
-  // レジスタアドレス: 0xE1 にNVMのプロテクト領域がある (HM p.171)
-  // 下位2bit 00: read/write/erase 可能
-  //          01: read禁止
-  //          10: write/erase 禁止
-  //          11: read/write/erase 禁止
-  i2cBuffer[0] = 0xE1;
-  i2cBuffer[1] = 0x00;
-  Wire.write(control_code, i2cBuffer,
-             2); // MASK_CONTROLCODEは Control Code:slave
-                 // addressを残しresisterアクセスにするためのマスク
-
-  i2cBuffer[0] = 0xE1;
-  Wire.write(control_code, i2cBuffer, 1);
-
-  Wire.read(control_code, i2cBuffer, 1);
-  uint8_t val = i2cBuffer[0];
-  //  pc.printf("reg address:0xE1 = %02x\n", val); //
-  //  0x00ならプロテクト解除されている
-}
+scriptStep_t scriptSteps[Z_scriptSteps]; //<! 結果
+int scriptCount = 0;                     //<! 実行したcommand数
+bool scriptActive = false;               //<! true:script実行中
 
-//*************************************
 /**
- * 指示memory領域のクリア指示
+ * file から読んだ1行をcommandの形式にする
  *
- * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER クリア対象領域の指示 　
- * @return 0:正常終了 -1:異常終了
+ * 小文字は大文字にし、空白,','と'#'以降(comment)を取り除く
  */
-//*************************************
-int eraseChip(greenPakMemory_t memoryType) {
-  int slaveAddress = checkSlaveAddres();
-  if (slaveAddress == 0xff) {
-    pc.printf("not found IC\n");
-
-    return -1;
-  }
-
-  int control_code =
-      (slaveAddress << 4) |
-      RESISTER_CONFIG; // ControlCode(A14-11)=slaveAddress(4bit) +
-                       // BlockAddress(A10-8)=000b
-  int addressForAckPolling = control_code;
-
-  pc.printf("slave address =  0x%02x\n", slaveAddress);
-
-  printMemoryType(memoryType);
-
-  if (memoryType == RESISTER) {
-    pc.printf("RESISTER don't erase area\n");
-    return (0);
-  }
-
-  resister_unprotect();
-
-  for (uint8_t i = 0; i < 16; i++) {
-    pc.printf("Erasing page: 0x%02x ", i);
-
-    i2cBuffer[0] = 0xE3; // I2C Word Address
-    // Page Erase Register
-    // bit7: ERSE  1
-    // bit4: ERSEB4  0: NVM, 1:EEPROM
-    // bit3-0: ERSEB3-0: page address
-    if (memoryType == NVM) {
-      pc.printf("NVM ");
-      i2cBuffer[1] = (0x80 | i);
-    } else if (memoryType == EEPROM) {
-      pc.printf("EEPROM ");
-      i2cBuffer[1] = (0x90 | i);
-    }
-    Wire.write(control_code, i2cBuffer,
-               2); // Control BYte = ControlCode + Block Address
-
-    wait(0.1);
-
-    /* To accommodate for the non-I2C compliant ACK behavior of the Page Erase
-     * Byte, we've removed the software check for an I2C ACK and added the
-     * "Wire.endTransmission();" line to generate a stop condition.
-     *  - Please reference "Issue 2: Non-I2C Compliant ACK Behavior for the NVM
-     * and EEPROM Page Erase Byte" in the SLG46824/6 (XC revision) errata
-     * document for more information.
-     *
-     * 要約: たまにNACKを返すことがあるので、無条件に終了させればよい。
-     * https://medium.com/dialog-semiconductor/slg46824-6-arduino-programming-example-1459917da8b
-     */
-
-    // tER(20ms)の処理終了待ち
-    if (ackPolling(addressForAckPolling) == -1) {
-      pc.printf("NG\n");
-      return -1;
-    } else {
-      pc.printf("ready \n");
-      wait(0.1);
+void scriptNormalize(char *text) {
+  char *q = text;
+  for (char *p = text; (*p != '\0') && (*p != '#'); p++) {
+    if ((*p == ' ') || (*p == ',') || (*p == '\t') || (*p == '\r') ||
+        (*p == '\n')) {
+      continue;
     }
+    *q++ = toupper(*p);
   }
-  pc.printf("\n");
-
-  powercycle();
-  return 0;
+  *q = '\0';
 }
 
-//*************************************
 /**
- * 指示memory領域への書き込み指示
+ * ;で区切った1行分のcommandの実行
  *
- * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示 　
- * @param[in] int NVM書き込み時にslave addressを変更する場合に指示(NVMのみ必要)
- * つけなければ現状と同じaddressを設定する
- * @return 0:正常終了 -1:異常終了
+ * @param[in,out] char* line: command(区切りの;は'\0'に書き換える)
+ * @return 0:全て正常終了 0以外:最初に失敗したcommandの戻り値
  */
-//*************************************
-int writeChip(greenPakMemory_t memoryType, int nextSlaveAddress = 0xff) {
-  int control_code = 0x00;
-  int addressForAckPolling = 0x00;
-
-  int ans;
-
-  uint8_t nowSlaveAddress = checkSlaveAddres();
-  if (nowSlaveAddress == 0xff) {
-    pc.printf("not found IC\n");
-
-    return -1;
-  }
+int scriptLine(char *line) {
+  char *p = line;
 
-  pc.printf("slave address =  0x%02x\n", nowSlaveAddress);
-
-  if (memoryType == NVM) {
-    if ((nextSlaveAddress < 0x00) || (0x0f < nextSlaveAddress)) {
-      nextSlaveAddress = nowSlaveAddress;
+  while (p != NULL) {
+    char *next = strchr(p, ';');
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+    if (*p != '\0') {
+      hexCacheTick(); // 長いSCRIPT.txtの間も経過時間を数える
+      pc.log(CONSOLE_QUIET, ">%s\n", p);
+      uint32_t start = Wire.read_us();
+      int ans = commandExecute(p);
+      if (scriptCount < Z_scriptSteps) {
+        scriptStep_t *step = &scriptSteps[scriptCount];
+        strncpy(step->command, p, sizeof(step->command) - 1);
+        step->command[sizeof(step->command) - 1] = '\0';
+        step->result = ans;
+        step->us = Wire.read_us() - start;
+      }
+      scriptCount++;
+      if (ans != 0) {
+        return ans;
+      }
     }
-    pc.printf("next slave address = 0x%02x\n", nextSlaveAddress);
+    p = next;
   }
+  return 0;
+}
 
-  printMemoryType(memoryType);
-
-  if (memoryType == NVM) {
-
-    resister_unprotect();
+/**
+ * command scriptの実行
+ *
+ * commandを入力待ちなしで順に実行し、失敗したcommandで止める
+ * 最後にcommandごとの結果と時間を表示する
+ * @param[in,out] char* line: ;で区切ったcommand NULL:/local/SCRIPT.txtを実行
+ * @return 0:全て正常終了 0以外:最初に失敗したcommandの戻り値
+ */
+int scriptRun(char *line) {
+  char text[Z_pcBuffer];
+  int ans = 0;
 
-    // Serial.println(F("Writing NVM"));
-    // Set the slave address to 0x00 since the chip has just been erased
-    // Set the control code to 0x00 since the chip has just been erased
-    control_code = nowSlaveAddress << 4;
-    control_code |= NVM_CONFIG;
-    addressForAckPolling = nowSlaveAddress << 4;
-    if (hexFileRead(NVM) != 16) {
-      return -1;
-    };
-  } else if (memoryType == EEPROM) {
-    // pc.printf("Writing EEPROM\n");
-    control_code = nowSlaveAddress << 4;
-    control_code |= EEPROM_CONFIG;
-    addressForAckPolling = nowSlaveAddress << 4;
-    if (hexFileRead(EEPROM) != 16) {
-      return -1;
-    };
-  } else if (memoryType == RESISTER)
-  {
-    // Serial.println(F("Writing RESISTER"));
-    control_code = nowSlaveAddress << 4;
-    control_code |= RESISTER_CONFIG;
-    addressForAckPolling = nowSlaveAddress << 4;
-    if (hexFileRead(NVM) != 16) {
-      return -1;
-    };
-  }
-  pc.printf("\n");
-
-  if (memoryType == NVM) {
-    // nextSlaveAddressに設定されている値に差し替える
-    // レジスタアドレス=0xcaのbit3-0 にI2C slave address を設定する
-    // bit7-4:
-    // 0にすると下位4bitのアドレスが有効になる(1にするとIO2,3,4,5の端子状態がアドレスになる)
-    //
-    // レジスタを書き換える場合にはslave address の書き換えは行わない
-    // この場合に書き換えると、この直後からアドレスが切り替わりその後の書き込みができなくなる
-    hexData[0xC][0xA] = (hexData[0xC][0xA] & 0xF0) | nextSlaveAddress;
-  } else if (memoryType == RESISTER) {
-    hexData[0xC][0xA] = (hexData[0xC][0xA] & 0xF0) | nowSlaveAddress;
+  if (scriptActive) {
+    pc.log(CONSOLE_QUIET, "script in script\n");
+    return -2;
   }
+  scriptActive = true;
+  scriptCount = 0;
+  uint32_t start = Wire.read_us();
 
-  // erase
-  if (memoryType != RESISTER) {
-    pc.printf("erase start\n");
-    if (eraseChip(memoryType) == 0) {
-      wait(0.3); // erase後の安定待ち(これが無いとこの後の書き込みでエラーになる)
-      pc.printf("erase OK\n");
-    } else {
-      pc.printf("erase NG\n");
-      return -1;
-    }
+  if (line != NULL) {
+    ans = scriptLine(line);
   } else {
-    pc.printf("RESISTER don't erase area\n");
-  }
-
-  // Write each byte of hexData[][] array to the chip
-  for (int i = 0; i < 16; i++) {
-    i2cBuffer[0] = i << 4;
-    pc.printf("%02x: ", i);
-
-    for (int j = 0; j < 16; j++) {
-      i2cBuffer[j + 1] = hexData[i][j];
-      pc.printf("%02x ", hexData[i][j]);
-    }
-    ans = Wire.write(control_code, i2cBuffer, 17);
-    wait(0.01);
-
-    if (ans != 0) {
-      pc.printf(" nack\n");
-      pc.printf("Oh No! Something went wrong while programming!\n");
-      Wire.stop();
+    FILE *fp = localOpen("SCRIPT.txt", "r");
+    if (fp == NULL) {
+      pc.log(CONSOLE_QUIET, "SCRIPT.txt not found\n");
+      scriptActive = false;
       return -1;
     }
-
-    pc.printf(" ack ");
-
-    if (ackPolling(addressForAckPolling) == -1) {
-      return -1;
-    } else {
-      pc.printf("ready\n");
-      wait(0.1);
+    while ((ans == 0) && (fgets(text, sizeof(text), fp) != NULL)) {
+      scriptNormalize(text);
+      ans = scriptLine(text);
     }
+    fclose(fp);
   }
-
-  Wire.stop();
-
-  // NVMを書き換えたら再起動させて動作に反映させる
-  if (memoryType == NVM) {
-    powercycle();
+  uint32_t us = Wire.read_us() - start;
+  scriptActive = false;
+
+  pc.log(CONSOLE_QUIET, "\nno  command result  time[ms]\n");
+  for (int i = 0; (i < scriptCount) && (i < Z_scriptSteps); i++) {
+    scriptStep_t *step = &scriptSteps[i];
+    pc.log(CONSOLE_QUIET, "%2d  %-7s %-6s %9lu\n", i + 1, step->command,
+           (step->result == 0) ? "OK" : "NG",
+           (unsigned long)(step->us / 1000));
   }
-  return 0;
+  pc.log(CONSOLE_QUIET, "script %s: %d commands, %lums\n",
+         (ans == 0) ? "OK" : "NG", scriptCount, (unsigned long)(us / 1000));
+  return ans;
 }
 
-//*************************************
+//=====================================
+// 量産モード
+//=====================================
+#define Z_productionPollS (0.05f)  //<! GreenPakの抜き差しの確認間隔[s]
+#define Z_productionSettleS (0.2f) //<! 差し込みを見つけてから書き込むまでの待ち[s]
+#define Z_productionRemoved (4) //<! 続けてこの回数見つからなければ取り外したとする
+
 /**
- * 指示memory領域からの読み込み指示
+ * 量産モード
  *
- * @param[in] greenPakMemory_t NVM,EEPROM,RESISTER 対象領域の指示 　
- * @return 0:正常終了 -1:異常終了
+ * GreenPakの差し込みを待ち、書き込み,確認をしてLEDで結果を示し、取り外しを待つ
+ * を繰り返す。PCから何か入力があると終了して集計を表示する
+ * @param[in] bool eeprom: true:NVMとEEPROMに書き込む false:NVMだけに書き込む
+ * @return 0:正常終了 -1:書き込みデータがない
  */
-//*************************************
-int readChip(greenPakMemory_t memoryType) {
-  int slaveAddress = checkSlaveAddres();
-  if (slaveAddress == 0xff) {
-    pc.printf("not found IC\n");
+int productionRun(bool eeprom) {
+  if (productionBegin(eeprom) != 0) {
     return -1;
   }
-
-  uint8_t control_code = slaveAddress << 4;
-
-  pc.printf("slave address =  0x%02x\n", slaveAddress);
-
-  printMemoryType(memoryType);
-
-  // I2C Block Addressの設定
-  // A9=1, A8=0: NVM (0x02)
-  // A9=1, A8=1: EEPROM (0x03)
-  if (memoryType == NVM) {
-    control_code |= NVM_CONFIG;
-  } else if (memoryType == EEPROM) {
-    control_code |= EEPROM_CONFIG;
-  } else if (memoryType == RESISTER)
-  {
-    control_code |= RESISTER_CONFIG;
-
-  }
-
-  for (int i = 0; i < 16; i++) {
-    pc.printf("%02x :", i);
-
-    i2cBuffer[0] = i << 4;
-    Wire.write(control_code, i2cBuffer, 1, true);
-    wait(0.01);
-
-    Wire.read(control_code, i2cBuffer, 16, true);
-
-    for (int j = 0; j < 16; j++) {
-      pc.printf("%02x ", i2cBuffer[j]);
+  pc.log(CONSOLE_QUIET, "production mode (press enter to stop)\n");
+  ledopen = 0;
+  ledout = 0;
+  lederror = 0;
+
+  while (pcSerial.readable() == 0) {
+    // 差し込み待ち
+    productionTick();
+    hexCacheTick();
+    if (checkSlaveAddres() == 0xff) {
+      Wire.wait(Z_productionPollS);
+      continue;
     }
-    pc.printf("\n");
+    ledopen = 1;
+    ledout = 0;
+    lederror = 0;
+    Wire.wait(Z_productionSettleS);
+
+    int ans = productionPart(&session);
+    ledopen = 0;
+    ledout = (ans == 0);
+    lederror = (ans != 0);
+
+    // 取り外し待ち
+    int missing = 0;
+    while ((missing < Z_productionRemoved) && (pcSerial.readable() == 0)) {
+      productionTick();
+      hexCacheTick();
+      missing = (checkSlaveAddres() == 0xff) ? (missing + 1) : 0;
+      Wire.wait(Z_productionPollS);
+    }
+    deviceInvalidate(&session);
+    ledout = 0;
+    lederror = 0;
+  }
+  while (pcSerial.readable()) {
+    pcSerial.getc(); // 終了用の入力は読み捨てる
   }
-  Wire.stop();
+
+  productionEnd();
+  productionPrint();
   return 0;
 }
 
@@ -807,110 +1185,30 @@ int readChip(greenPakMemory_t memoryType) {
  */
 //*************************************
 int main() {
-  int ans;
   //  pc.format(8,Serial::Even,1);
-  pc.baud(PC_BOUD);
-  Wire.frequency(10000);
+  pcSerial.baud(PC_BOUD);
+  pcTxTicker.attach_us(callback(&serialConsole, &SerialConsole::drain), 1000);
+  Wire.frequency(Z_busHzSafe);
+  if (settleLoad() == 0) {
+    settlePrint();
+  }
 
   pc.printf("\n>");
   while (1) {
 
     if (pcRecive() == 1) {
-      char *p = B_pcRx;
-      switch (*p++) {
-      case 'E':
-        pc.printf("erase start\n");
-        switch (*p++) {
-        case 'N':
-          ans = eraseChip(NVM);
-          break;
-        case 'E':
-          ans = eraseChip(EEPROM);
-          break;
-        case 'R':
-        default:
-          ans = -2;
-          break;
-        }
-
-        switch (ans) {
-        case 0:
-          pc.printf("erase OK\n");
-          break;
-        case -1:
-          pc.printf("erase NG\n");
-        case -2:
-        default:
-          pc.printf("command error\n");
-          break;
-        }
-        break;
-      case 'P':
-        ping();
-        break;
-      case 'R':
-        pc.printf("Reading chip!\n");
-        switch (*p++) {
-        case 'N':
-          ans = readChip(NVM);
-          break;
-        case 'E':
-          ans = readChip(EEPROM);
-          break;
-        case 'R':
-          ans = readChip(RESISTER);
-          break;
-        default:
-          ans = -2;
-        }
-
-        switch (ans) {
-        case 0:
-          pc.printf("read OK\n");
-          break;
-        case -1:
-          break;
-          pc.printf("read NG\n");
-        case -2:
-        default:
-          pc.printf("command error\n");
-          break;
-        }
-        break;
-      case 'W':
-        switch (*p++) {
-        case 'N':
-          ans = writeChip(NVM, atoh1(p));
-          break;
-        case 'E':
-          ans = writeChip(EEPROM);
-          break;
-        case 'R':
-          ans = writeChip(RESISTER);
-          break;
-        default:
-          ans = -2;
-          break;
-        }
-
-        switch (ans) {
-        case 0:
-          pc.printf("write OK\n");
-          break;
-        case -1:
-          pc.printf("write NG\n");
-          break;
-        case -2:
-          pc.printf("command error\n");
-          break;
-        }
-        pc.printf("\n");
-        break;
-      case 'D':
-        pc.printf("D input\n");
-        break;
+      // 処理時間は1行のcommandごとに記録し直す(表示,バックグラウンド処理中は除く)
+      if ((B_pcRx[0] != 'T') && !jobBusy()) {
+        traceBegin();
+      }
+      if (strchr(B_pcRx, ';') != NULL) {
+        scriptRun(B_pcRx);
+      } else {
+        commandExecute(B_pcRx);
       }
       pc.printf("\n>");
     }
+    jobStep();
+    hexCacheTick();
   }
 }